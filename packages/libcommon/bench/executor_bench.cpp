@@ -0,0 +1,203 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <argparse/argparse.hpp>
+#include <fmt/format.h>
+
+#include <common/executor.hpp>
+
+/**
+ * Tasks per second through cm::Executor, and heap allocations per task,
+ * next to a std::function queue behind one mutex, the way the executor used to queue tasks.
+ */
+
+namespace {
+
+std::atomic_uint64_t s_allocations { 0 };
+
+}
+
+void* operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+/**
+ * The reference: std::function tasks in a deque behind one mutex, every worker waiting on one condition variable.
+ */
+class MutexQueuePool {
+public:
+    explicit MutexQueuePool(size_t num_workers)
+    {
+        for (size_t i = 0; i < num_workers; i++)
+            m_workers.emplace_back([this]() { worker(); });
+    }
+
+    ~MutexQueuePool()
+    {
+        {
+            std::scoped_lock lk(m_mutex);
+            m_stopping = true;
+        }
+
+        m_cv.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    void push_task(std::function<void()> task)
+    {
+        {
+            std::scoped_lock lk(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+
+        m_cv.notify_one();
+    }
+
+private:
+    void worker()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lk(m_mutex);
+                m_cv.wait(lk, [this]() { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                    return;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::mutex m_mutex {};
+    std::condition_variable m_cv {};
+    std::deque<std::function<void()>> m_tasks {};
+    bool m_stopping { false };
+    std::vector<std::thread> m_workers {};
+};
+
+struct Result {
+    double tasks_per_second;
+    double allocations_per_task;
+};
+
+/**
+ * Push num_tasks tasks from this thread, each capturing 40 bytes, and wait until every one ran.
+ * With a window, the pusher waits while that many tasks are queued, 0 pushes as fast as it can.
+ */
+template<typename Push>
+Result run(size_t num_tasks, size_t window, Push&& push)
+{
+    std::atomic_uint64_t done { 0 };
+    std::array<uint64_t, 4> payload { 1, 2, 3, 4 };
+
+    auto allocations_before = s_allocations.load(std::memory_order_relaxed);
+    auto started = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < num_tasks; i++) {
+        while (window != 0 && i - done.load(std::memory_order_relaxed) >= window)
+            std::this_thread::yield();
+
+        push([&done, payload]() {
+            done.fetch_add(payload[0], std::memory_order_relaxed);
+        });
+    }
+
+    while (done.load(std::memory_order_relaxed) < num_tasks)
+        std::this_thread::yield();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    auto allocations = s_allocations.load(std::memory_order_relaxed) - allocations_before;
+
+    return Result {
+        .tasks_per_second = double(num_tasks) / elapsed.count(),
+        .allocations_per_task = double(allocations) / double(num_tasks),
+    };
+}
+
+void print(const char* name, const Result& result)
+{
+    std::cout << fmt::format("{:<14} {:8.3f} Mtasks/s {:6.2f} allocs/task", name, result.tasks_per_second / 1e6, result.allocations_per_task) << std::endl;
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    argparse::ArgumentParser program("executor_bench");
+
+    program.add_argument("-n", "--tasks")
+        .help("Tasks pushed per run")
+        .default_value(size_t(2'000'000))
+        .scan<'u', size_t>();
+    program.add_argument("-w", "--workers")
+        .help("Worker threads")
+        .default_value(size_t(2))
+        .scan<'u', size_t>();
+    program.add_argument("--window")
+        .help("Most tasks queued at once, 0 for no limit. The executor's shared ring holds 4096, more spill into an allocating overflow queue")
+        .default_value(size_t(0))
+        .scan<'u', size_t>();
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    auto num_tasks = program.get<size_t>("--tasks");
+    auto num_workers = program.get<size_t>("--workers");
+    auto window = program.get<size_t>("--window");
+    std::cout << fmt::format("{} tasks of 40 bytes, {} workers, window {}", num_tasks, num_workers, window) << std::endl;
+
+    {
+        MutexQueuePool pool(num_workers);
+        print("mutex queue", run(num_tasks, window, [&](auto task) { pool.push_task(std::move(task)); }));
+    }
+
+    {
+        cm::Executor executor(num_workers, cm::Executor::Mode::Fifo);
+        print("fifo", run(num_tasks, window, [&](auto task) { executor.push_task(std::move(task)); }));
+    }
+
+    {
+        cm::Executor executor(num_workers, cm::Executor::Mode::WorkStealing);
+        print("work stealing", run(num_tasks, window, [&](auto task) { executor.push_task(std::move(task)); }));
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string_view>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+namespace cm {
+
+enum class LogLevel : uint8_t {
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+/**
+ * Layout of the binary log written by LogMode::Binary: kMagic, then records of [RecordType u8][payload size u32][payload], in native byte order.
+ *  - Definition: [id u32][LogLevel u8][format string]
+ *  - Event: [id u32][timestamp, ns since epoch, i64][arguments as [ArgType u8][value]]
+ *  - Dropped: [timestamp i64][count u64]
+ * A definition always comes before the first event using its id.
+ */
+namespace binary_log {
+
+inline constexpr std::string_view kMagic { "CMLOG\x01\n\0", 8 };
+
+enum class RecordType : uint8_t {
+    Definition = 1,
+    Event = 2,
+    Dropped = 3,
+};
+
+enum class ArgType : uint8_t {
+    Bool = 1,
+    Char,
+    Int,
+    UInt,
+    Double,
+    // [size u32][bytes]
+    String,
+    Pointer,
+};
+
+template<typename V>
+void put(fmt::memory_buffer& buffer, const V& value)
+{
+    static_assert(std::is_trivially_copyable_v<V>);
+    const auto* bytes = reinterpret_cast<const char*>(&value);
+    buffer.append(bytes, bytes + sizeof(V));
+}
+
+inline void put_string(fmt::memory_buffer& buffer, std::string_view value)
+{
+    put(buffer, static_cast<uint32_t>(value.size()));
+    buffer.append(value.data(), value.data() + value.size());
+}
+
+/**
+ * Arithmetic values, strings and pointers are copied as is, anything else is formatted with "{}" on the spot.
+ */
+template<typename A>
+void encode_arg(fmt::memory_buffer& buffer, const A& arg)
+{
+    using V = std::remove_cvref_t<A>;
+    if constexpr (std::is_same_v<V, bool>) {
+        put(buffer, ArgType::Bool);
+        put(buffer, arg);
+    } else if constexpr (std::is_same_v<V, char>) {
+        put(buffer, ArgType::Char);
+        put(buffer, arg);
+    } else if constexpr (std::is_integral_v<V> && std::is_signed_v<V>) {
+        put(buffer, ArgType::Int);
+        put(buffer, static_cast<int64_t>(arg));
+    } else if constexpr (std::is_integral_v<V>) {
+        put(buffer, ArgType::UInt);
+        put(buffer, static_cast<uint64_t>(arg));
+    } else if constexpr (std::is_floating_point_v<V>) {
+        put(buffer, ArgType::Double);
+        put(buffer, static_cast<double>(arg));
+    } else if constexpr (std::is_convertible_v<const V&, std::string_view>) {
+        put(buffer, ArgType::String);
+        put_string(buffer, std::string_view(arg));
+    } else if constexpr (std::is_pointer_v<V>) {
+        put(buffer, ArgType::Pointer);
+        put(buffer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(arg)));
+    } else {
+        put(buffer, ArgType::String);
+        put_string(buffer, fmt::format("{}", arg));
+    }
+}
+
+template<typename... T>
+void encode_event(fmt::memory_buffer& buffer, uint32_t id, std::chrono::system_clock::time_point time, const T&... args)
+{
+    put(buffer, RecordType::Event);
+    size_t size_offset = buffer.size();
+    put(buffer, uint32_t(0));
+
+    put(buffer, id);
+    put(buffer, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count()));
+    (encode_arg(buffer, args), ...);
+
+    auto payload_size = static_cast<uint32_t>(buffer.size() - size_offset - sizeof(uint32_t));
+    std::memcpy(buffer.data() + size_offset, &payload_size, sizeof(payload_size));
+}
+
+}
+
+/**
+ * Render a binary log as the text LogMode::Text would have written.
+ * Records that can not be decoded are reported inline, a truncated file stops at the last whole record.
+ *
+ * @param min_level Skip events below this level.
+ * @return False if input is not a binary log.
+ */
+bool decode_binary_log(std::istream& input, std::ostream& output, LogLevel min_level = LogLevel::Trace);
+
+}
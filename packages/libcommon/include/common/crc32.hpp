@@ -2,10 +2,16 @@
 
 #include <cstdint>
 #include <span>
+#include <string_view>
 #include <vector>
 
 namespace cm {
 
+/**
+ * CRC-32C (Castagnoli).
+ * Uses the SSE4.2 crc32 instruction over three interleaved streams folded with PCLMULQDQ when the CPU has both,
+ * the crc32 instruction alone with SSE4.2 only, and slicing-by-8 tables otherwise. The choice is made once, from CPUID.
+ */
 class CRC32 {
 public:
     CRC32() = default;
@@ -25,6 +31,11 @@ public:
 
     uint32_t digest() const;
 
+    /**
+     * Name of the implementation picked for this CPU, for logs.
+     */
+    static std::string_view implementation_name();
+
 private:
     uint32_t m_state { 0xFFFFFFFF };
 };
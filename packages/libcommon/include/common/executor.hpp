@@ -1,49 +1,129 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <ranges>
 #include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "./histogram.hpp"
 #include "./logger.hpp"
+#include "./mpmc_queue.hpp"
+#include "./timer_wheel.hpp"
+#include "./unique_function.hpp"
 
 namespace cm {
 
-class [[nodiscard]] Executor {
-public:
-    explicit Executor(size_t num_concurrency)
-    {
-        m_threads.reserve(num_concurrency);
-        for (size_t i = 0; i < num_concurrency; i++) {
-            m_threads.emplace_back(&Executor::worker, this);
+namespace detail {
+
+/**
+ * Like std::bind, but keeps move-only arguments and does not wrap argument-less callables at all.
+ * Arguments are stored decayed and moved into the function, a task only runs once.
+ */
+template<typename F, typename... A>
+auto bind_task(F&& task, A&&... args)
+{
+    if constexpr (sizeof...(A) == 0) {
+        return std::forward<F>(task);
+    } else {
+        return [task = std::forward<F>(task), ... args = std::forward<A>(args)]() mutable {
+            return std::invoke(task, std::move(args)...);
+        };
+    }
+}
+
+template<typename R, typename F>
+void fulfil_promise(std::promise<R>& promise, F& fn)
+{
+    try {
+        if constexpr (std::is_void_v<R>) {
+            std::invoke(fn);
+            promise.set_value();
+        } else {
+            promise.set_value(std::invoke(fn));
+        }
+    } catch (...) {
+        try {
+            promise.set_exception(std::current_exception());
+        } catch (...) {
         }
     }
+}
+
+}
+
+class [[nodiscard]] Executor {
+public:
+    enum class Mode {
+        /**
+         * Every task goes through one shared queue and tasks start in the order they were pushed.
+         * A single threaded Executor in this mode can be used to serialize work.
+         */
+        Fifo,
+        /**
+         * Every worker owns a deque. A worker pops its newest task first (LIFO),
+         * and when it runs dry it steals the oldest task of a random victim before parking.
+         * Tasks pushed from outside the pool are spread round-robin over the workers.
+         * No ordering is guaranteed between tasks.
+         */
+        WorkStealing,
+    };
+
+    // Timing metrics are taken on one task in kMetricsSampleRate per pushing thread, counters cover every task.
+    static constexpr uint32_t kMetricsSampleRate = 16;
+
+    /**
+     * Counters since the executor started, sampled without stopping the workers.
+     * Diff two samples with since() to get rates and percentiles over an interval.
+     */
+    struct Metrics {
+        struct WorkerMetrics {
+            uint64_t tasks_executed { 0 };
+            std::chrono::nanoseconds busy_time { 0 };
+        };
+
+        std::chrono::nanoseconds uptime { 0 };
+        size_t queue_depth { 0 };
+        uint64_t tasks_executed { 0 };
+        // In microseconds, from push to start and from start to finish, over one task in kMetricsSampleRate.
+        Histogram::Snapshot wait_time {};
+        Histogram::Snapshot run_time {};
+        std::vector<WorkerMetrics> workers {};
+
+        /**
+         * Fraction of uptime the worker spent running tasks, in [0, 1].
+         */
+        [[nodiscard]] double busy_ratio(size_t worker) const;
+        [[nodiscard]] double tasks_per_second() const;
+
+        /**
+         * Everything that happened after previous was sampled, queue_depth stays the current one.
+         */
+        [[nodiscard]] Metrics since(const Metrics& previous) const;
+    };
+
+    explicit Executor(size_t num_concurrency, Mode mode = Mode::Fifo);
 
     /**
      * Destruct the thread pool. Waits for all tasks to complete, then destroys all threads.
      */
-    ~Executor()
-    {
-        wait_for_tasks();
+    ~Executor();
 
-        {
-            const std::scoped_lock tasks_lock(m_tasks_mutex);
-            m_workers_running = false;
-        }
-        m_task_available_cv.notify_all();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
 
-        for (auto& thread : m_threads) {
-            if (thread.joinable())
-                thread.join();
-        }
-    }
+    [[nodiscard]] size_t concurrency() const noexcept { return m_workers.size(); }
+    [[nodiscard]] Mode mode() const noexcept { return m_mode; }
 
     /**
      * Push a function with zero or more arguments, but no return value, into the task queue. Does not return a future, so the user must use wait_for_tasks() or some other method to ensure that the task finishes executing, otherwise bad things will happen.
@@ -54,13 +134,32 @@ public:
     template<typename F, typename... A>
     void push_task(F&& task, A&&... args)
     {
-        auto task_fn = std::bind(std::forward<F>(task), std::forward<A>(args)...);
+        enqueue(detail::bind_task(std::forward<F>(task), std::forward<A>(args)...));
+    }
 
-        {
-            const std::scoped_lock tasks_lock(m_tasks_mutex);
-            m_tasks.push(task_fn); // cppcheck-suppress ignoredReturnValue
+    /**
+     * Push every callable of a range at once: the counters are bumped once, the tasks go into one queue under a single lock,
+     * and only as many parked workers are woken as there are tasks.
+     * Callables are moved out of an rvalue range and copied out of an lvalue one.
+     *
+     * @param tasks A range of callables taking no arguments.
+     */
+    template<typename Range>
+    void push_batch(Range&& tasks)
+    {
+        std::vector<Task> batch;
+        if constexpr (std::ranges::sized_range<Range>)
+            batch.reserve(std::ranges::size(tasks));
+
+        for (auto&& task : tasks) {
+            if constexpr (std::is_lvalue_reference_v<Range>) {
+                batch.emplace_back(task);
+            } else {
+                batch.emplace_back(std::move(task));
+            }
         }
-        m_task_available_cv.notify_one();
+
+        enqueue_batch(batch);
     }
 
     /**
@@ -78,92 +177,167 @@ public:
     template<typename F, typename... A, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...>>
     [[nodiscard]] std::future<R> submit(F&& task, A&&... args)
     {
-        std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
+        std::promise<R> task_promise;
+        auto future = task_promise.get_future();
         push_task(
-            [task_function = std::bind(std::forward<F>(task), std::forward<A>(args)...), task_promise] {
-                try {
-                    if constexpr (std::is_void_v<R>) {
-                        std::invoke(task_function);
-                        task_promise->set_value();
-                    } else {
-                        task_promise->set_value(std::invoke(task_function));
-                    }
-                } catch (...) {
-                    try {
-                        task_promise->set_exception(std::current_exception());
-                    } catch (...) {
-                    }
-                }
+            [task_function = detail::bind_task(std::forward<F>(task), std::forward<A>(args)...), task_promise = std::move(task_promise)]() mutable {
+                detail::fulfil_promise(task_promise, task_function);
             });
 
-        return task_promise->get_future();
+        return future;
     }
 
     /**
-     * Wait for tasks to be completed, both those that are currently running in the threads and those that are still m_waiting in the queue.
+     * Wait for tasks to be completed, both those that are currently running in the threads and those that are still waiting in the queue.
      * Note: To wait for just one specific task, use submit() instead, and call the wait() member function of the generated future.
      */
-    void wait_for_tasks()
+    void wait_for_tasks();
+
+    /**
+     * Push a task into the queue once delay has elapsed.
+     * Timers are kept in a hierarchical timer wheel with millisecond ticks, driven by one timer thread started on first use.
+     *
+     * @return An id to be passed to cancel_timer().
+     */
+    template<typename F>
+    TimerId schedule_after(std::chrono::milliseconds delay, F&& task)
     {
-        std::unique_lock tasks_lock(m_tasks_mutex);
-        m_waiting = true;
-        m_tasks_done_cv.wait(tasks_lock, [this] { return !m_tasks_running && m_tasks.empty(); });
-        m_waiting = false;
+        return add_timer(delay, std::make_shared<Timer>(std::forward<F>(task), std::chrono::milliseconds::zero()));
     }
 
-private:
     /**
-     * A worker function to be assigned to each thread in the pool.
-     * Waits until it is notified by push_task() that a task is available,
-     * and then retrieves the task from the queue and executes it.
-     * Once the task finishes, the worker notifies wait_for_tasks() in case it is m_waiting.
+     * Push a task into the queue every period until the timer is cancelled.
+     * The first run is delayed by a random phase in [0, phase_jitter) on top of period, so that thousands of timers created at once
+     * do not all fire in the same millisecond. phase_jitter defaults to period, pass zero to keep every timer in phase.
+     * A run is skipped if the previous one has not finished yet, runs of one timer never overlap.
+     *
+     * @return An id to be passed to cancel_timer().
      */
-    void worker()
+    template<typename F>
+    TimerId schedule_every(std::chrono::milliseconds period, F&& task, std::optional<std::chrono::milliseconds> phase_jitter = std::nullopt)
     {
-        std::function<void()> task;
-        while (true) {
-            std::unique_lock tasks_lock(m_tasks_mutex);
-            m_task_available_cv.wait(tasks_lock, [this] { return !m_tasks.empty() || !m_workers_running; });
-            if (!m_workers_running)
-                break;
+        return add_timer(period + random_phase(phase_jitter.value_or(period)), std::make_shared<Timer>(std::forward<F>(task), period));
+    }
 
-            task = std::move(m_tasks.front());
-            m_tasks.pop();
+    /**
+     * Cancel a timer. Runs that are already queued are dropped, a run that already started is not interrupted.
+     *
+     * @return false if the timer already expired or was cancelled.
+     */
+    bool cancel_timer(TimerId id);
 
-            ++m_tasks_running;
-            tasks_lock.unlock();
+    /**
+     * Every worker keeps its own counters, this sums them up. Cheap enough to call from a UI refresh.
+     */
+    [[nodiscard]] Metrics metrics() const;
 
-            try {
-                task();
-            } catch (const std::exception& ex) {
-                cm::log("[Executor][ERROR] {}", ex.what());
-            } catch (const std::string& ex) {
-                cm::log("[Executor][ERROR] {}", ex);
-            } catch (const char* ex) {
-                cm::log("[Executor][ERROR] {}", ex);
-            } catch (...) {
-                cm::log("[Executor][ERROR] Unknown exception");
-            }
+private:
+    friend class Strand;
 
-            tasks_lock.lock();
-            --m_tasks_running;
+    using Task = UniqueFunction<void()>;
 
-            if (m_waiting && !m_tasks_running && m_tasks.empty())
-                m_tasks_done_cv.notify_all();
+    struct Timer {
+        template<typename F>
+        Timer(F&& task, std::chrono::milliseconds period)
+            : task(std::forward<F>(task))
+            , period(period)
+        {
         }
-    }
+
+        void run()
+        {
+            // Cleared only once the task returned or threw, so a periodic task slower than its period never runs twice at once.
+            struct Unqueue {
+                std::atomic_bool& queued;
+                ~Unqueue() { queued = false; }
+            } unqueue { queued };
+
+            if (!cancelled)
+                task();
+        }
+
+        Task task;
+        std::chrono::milliseconds period;
+        std::atomic_bool cancelled { false };
+        std::atomic_bool queued { false };
+
+        // Where an expired timer is sent to run, the executor itself when empty.
+        // Returns a task for the executor to push, so the timer thread can push all expired timers as one batch.
+        UniqueFunction<Task(const std::shared_ptr<Timer>&)> dispatch {};
+    };
+
+    TimerId add_timer(std::chrono::milliseconds delay, std::shared_ptr<Timer> timer);
+    static std::chrono::milliseconds random_phase(std::chrono::milliseconds phase_jitter);
+    uint64_t current_timer_tick() const;
+
+    /**
+     * Body of the timer thread: advances the timer wheel to the current tick, pushes every expired timer and re-arms periodic ones,
+     * then sleeps until the next tick that can expire something.
+     */
+    void timer_worker();
+
+    // Slots of the shared ring, and of every worker's own ring in WorkStealing mode.
+    static constexpr size_t kQueueCapacity = 4096;
+    static constexpr size_t kWorkerQueueCapacity = 256;
+
+    struct Worker;
+
+    struct Job {
+        Task task {};
+        // steady_clock nanoseconds, for the wait time metric
+        uint64_t enqueued_at { 0 };
+    };
+
+    void enqueue(Task task);
+    void enqueue_batch(std::vector<Task>& tasks);
+    void push_shared(Job& job);
+    bool pop_shared(Job& job);
+    void notify_parked(size_t count = 1);
+    size_t target_worker();
+
+    bool pop_task(size_t index, Job& job);
+    bool steal_task(size_t index, Job& job);
+
+    /**
+     * A worker function to be assigned to each thread in the pool.
+     * Looks for a task in its own deque, the shared queue and then the other workers' deques,
+     * parks until it is notified by push_task() when there is nothing to run.
+     * Once a task finishes, the worker notifies wait_for_tasks() in case it is waiting.
+     */
+    void worker(size_t index);
+    static void run_task(Task& task);
 
 private:
-    std::vector<std::thread> m_threads {};
+    Mode m_mode;
+    std::vector<std::unique_ptr<Worker>> m_workers {};
+
+    // Shared queue, tasks spill into the overflow deque only while the ring is full.
+    MpmcQueue<Job> m_tasks { kQueueCapacity };
+    std::mutex m_overflow_mutex {};
+    std::deque<Job> m_overflow_tasks {};
+    std::atomic_bool m_overflowing { false };
+
+    // Tasks sitting in any queue, and tasks either queued or running.
+    std::atomic_size_t m_tasks_queued { 0 };
+    std::atomic_size_t m_tasks_unfinished { 0 };
+    std::atomic_size_t m_next_worker { 0 };
+
+    std::mutex m_park_mutex {};
     std::condition_variable m_task_available_cv {};
-    std::condition_variable m_tasks_done_cv {};
-    std::queue<std::function<void()>> m_tasks {};
+    std::atomic_size_t m_workers_parked { 0 };
+    std::atomic_bool m_workers_running { true };
 
-    size_t m_tasks_running { 0 };
-    mutable std::mutex m_tasks_mutex {};
+    std::mutex m_done_mutex {};
+    std::condition_variable m_tasks_done_cv {};
 
-    bool m_waiting { false };
-    bool m_workers_running { true };
+    // Origin of timer ticks and of the uptime metric.
+    const std::chrono::steady_clock::time_point m_epoch { std::chrono::steady_clock::now() };
+    std::mutex m_timer_mutex {};
+    std::condition_variable m_timer_cv {};
+    std::thread m_timer_thread {};
+    TimerWheel<std::shared_ptr<Timer>> m_timers {};
+    TimerId m_next_timer_id { 1 };
+    bool m_timers_running { true };
 };
 
 }
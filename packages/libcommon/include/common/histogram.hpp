@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace cm {
+
+/**
+ * Log-linear histogram of unsigned samples: exact below 8, then 8 buckets per power of two, so a percentile is off by at most 12.5%.
+ * record() is lock free and can be called from any thread, it stays uncontended as long as every thread records into its own histogram.
+ * Readers take a Snapshot and merge or diff snapshots as they like.
+ */
+class Histogram {
+public:
+    static constexpr size_t kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    class Snapshot {
+    public:
+        [[nodiscard]] uint64_t count() const noexcept { return m_count; }
+        [[nodiscard]] uint64_t sum() const noexcept { return m_sum; }
+        [[nodiscard]] uint64_t max() const noexcept { return m_max; }
+        [[nodiscard]] double mean() const noexcept { return m_count == 0 ? 0.0 : double(m_sum) / double(m_count); }
+
+        /**
+         * @param quantile In [0, 1], e.g. 0.99 for the 99th percentile.
+         * @return The upper bound of the bucket holding the quantile, 0 if there are no samples.
+         */
+        [[nodiscard]] uint64_t percentile(double quantile) const noexcept
+        {
+            if (m_count == 0)
+                return 0;
+
+            auto rank = static_cast<uint64_t>(std::clamp(quantile, 0.0, 1.0) * double(m_count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; i++) {
+                seen += m_buckets[i];
+                if (seen >= rank)
+                    return std::min(upper_bound(i), m_max);
+            }
+
+            return m_max;
+        }
+
+        Snapshot& merge(const Snapshot& other) noexcept
+        {
+            for (size_t i = 0; i < kBuckets; i++) {
+                m_buckets[i] += other.m_buckets[i];
+            }
+
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_max = std::max(m_max, other.m_max);
+            return *this;
+        }
+
+        /**
+         * The samples recorded after previous was taken. max() still covers the whole lifetime, it can not be diffed.
+         */
+        [[nodiscard]] Snapshot since(const Snapshot& previous) const noexcept
+        {
+            Snapshot ret = *this;
+            for (size_t i = 0; i < kBuckets; i++) {
+                ret.m_buckets[i] -= std::min(ret.m_buckets[i], previous.m_buckets[i]);
+            }
+
+            ret.m_count -= std::min(ret.m_count, previous.m_count);
+            ret.m_sum -= std::min(ret.m_sum, previous.m_sum);
+            return ret;
+        }
+
+    private:
+        friend class Histogram;
+
+        std::array<uint64_t, kBuckets> m_buckets {};
+        uint64_t m_count { 0 };
+        uint64_t m_sum { 0 };
+        uint64_t m_max { 0 };
+    };
+
+    void record(uint64_t value) noexcept
+    {
+        m_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Same as record(), for a histogram that only one thread ever records into: plain loads and stores, no locked instructions.
+     */
+    void record_exclusive(uint64_t value) noexcept
+    {
+        auto& bucket = m_buckets[bucket_of(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > m_max.load(std::memory_order_relaxed))
+            m_max.store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * Not atomic as a whole, a snapshot taken while other threads record may be off by the samples in flight.
+     */
+    [[nodiscard]] Snapshot snapshot() const noexcept
+    {
+        Snapshot ret;
+        for (size_t i = 0; i < kBuckets; i++) {
+            ret.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        }
+
+        ret.m_count = m_count.load(std::memory_order_relaxed);
+        ret.m_sum = m_sum.load(std::memory_order_relaxed);
+        ret.m_max = m_max.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    static constexpr size_t bucket_of(uint64_t value) noexcept
+    {
+        if (value < kSubBuckets)
+            return value;
+
+        size_t exponent = std::bit_width(value) - 1;
+        size_t sub_bucket = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+        return (exponent - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+    }
+
+    static constexpr uint64_t lower_bound(size_t bucket) noexcept
+    {
+        if (bucket < kSubBuckets)
+            return bucket;
+
+        size_t exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+        return (kSubBuckets + bucket % kSubBuckets) << (exponent - kSubBucketBits);
+    }
+
+    static constexpr uint64_t upper_bound(size_t bucket) noexcept
+    {
+        return bucket + 1 < kBuckets ? lower_bound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+private:
+    std::array<std::atomic_uint64_t, kBuckets> m_buckets {};
+    std::atomic_uint64_t m_count { 0 };
+    std::atomic_uint64_t m_sum { 0 };
+    std::atomic_uint64_t m_max { 0 };
+};
+
+}
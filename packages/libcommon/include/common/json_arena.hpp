@@ -0,0 +1,150 @@
+#pragma once
+
+#include "./json.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cm {
+
+namespace detail {
+
+std::pmr::memory_resource*& current_json_resource() noexcept;
+
+/**
+ * The arenas alive right now, so that builds with CM_CHECK_JSON_ARENA can catch a value destroyed after its arena.
+ * Every lookup takes a global lock, which is why the check is opt in.
+ */
+void register_json_arena(const std::pmr::memory_resource* resource);
+void unregister_json_arena(const std::pmr::memory_resource* resource) noexcept;
+bool json_arena_alive(const std::pmr::memory_resource* resource) noexcept;
+
+}
+
+/**
+ * A monotonic arena for short lived JSON, a signaling message or everything a peer parsed.
+ * Allocation is a pointer bump, deallocation does nothing, and destroying the arena gives everything back at once.
+ *
+ * Not thread safe, allocate from one thread at a time. Must outlive every value allocated in it, also those copied or moved out of the scope.
+ */
+class JsonArena {
+public:
+    static constexpr size_t kDefaultInitialSize = 16 * 1024;
+
+    explicit JsonArena(size_t initial_size = kDefaultInitialSize)
+        : m_resource(initial_size)
+    {
+#ifdef CM_CHECK_JSON_ARENA
+        detail::register_json_arena(&m_resource);
+#endif
+    }
+
+    ~JsonArena()
+    {
+#ifdef CM_CHECK_JSON_ARENA
+        detail::unregister_json_arena(&m_resource);
+#endif
+    }
+
+    JsonArena(const JsonArena&) = delete;
+    JsonArena& operator=(const JsonArena&) = delete;
+
+    std::pmr::memory_resource* resource() noexcept { return &m_resource; }
+
+    /**
+     * Free everything allocated so far, no value allocated from it may be used afterwards.
+     */
+    void release() { m_resource.release(); }
+
+private:
+    std::pmr::monotonic_buffer_resource m_resource;
+};
+
+/**
+ * Routes every cm::ArenaJson allocation made on this thread to an arena, until the scope ends.
+ * Scopes nest. Do not keep one across a co_await, the coroutine may resume on another thread.
+ */
+class JsonArenaScope {
+public:
+    explicit JsonArenaScope(JsonArena& arena) noexcept
+        : m_previous(std::exchange(detail::current_json_resource(), arena.resource()))
+    {
+    }
+
+    ~JsonArenaScope() { detail::current_json_resource() = m_previous; }
+
+    JsonArenaScope(const JsonArenaScope&) = delete;
+    JsonArenaScope& operator=(const JsonArenaScope&) = delete;
+
+private:
+    std::pmr::memory_resource* m_previous;
+};
+
+/**
+ * Allocates from the arena of the innermost JsonArenaScope on this thread, or the heap outside of one.
+ *
+ * nlohmann::basic_json default constructs its allocator, so it cannot carry a std::pmr::polymorphic_allocator.
+ * Instead, every block remembers the resource it came from in a small header, so a value allocated in an arena
+ * can be copied, moved or destroyed outside of its scope, and heap blocks freed inside a scope go back to the heap.
+ * The header points into the arena: a value must not outlive its arena.
+ * Debug builds with CM_CHECK_JSON_ARENA defined assert it when the value is destroyed.
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    ArenaAllocator() noexcept = default;
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= kHeaderSize, "over-aligned types are not supported");
+
+        auto* resource = detail::current_json_resource();
+        if (!resource)
+            resource = std::pmr::new_delete_resource();
+
+        auto* block = static_cast<std::byte*>(resource->allocate(kHeaderSize + n * sizeof(T), kHeaderSize));
+        *reinterpret_cast<std::pmr::memory_resource**>(block) = resource;
+        return reinterpret_cast<T*>(block + kHeaderSize);
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        auto* block = reinterpret_cast<std::byte*>(p) - kHeaderSize;
+        auto* resource = *reinterpret_cast<std::pmr::memory_resource**>(block);
+#ifdef CM_CHECK_JSON_ARENA
+        assert((resource == std::pmr::new_delete_resource() || detail::json_arena_alive(resource)) && "ArenaJson destroyed after its JsonArena");
+#endif
+        resource->deallocate(block, kHeaderSize + n * sizeof(T), kHeaderSize);
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+
+private:
+    static constexpr size_t kHeaderSize = alignof(std::max_align_t);
+};
+
+/**
+ * nlohmann::json with its objects, arrays and values allocated through ArenaAllocator.
+ * Strings keep std::string, so get<std::string>() works as usual, only their long contents stay on the heap.
+ * Converts to and from nlohmann::json by copy.
+ */
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, int64_t, uint64_t, double, ArenaAllocator>;
+
+}
@@ -1,31 +1,234 @@
 #pragma once
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
 
 #include <fmt/core.h>
 #include <fmt/chrono.h>
 #include <fmt/format.h>
 
+#include "./binary_log.hpp"
+
+// Lowest level compiled in, calls below it are removed at compile time. 0 trace, 1 debug, 2 info, 3 warn, 4 error.
+#ifndef CM_LOG_LEVEL
+#define CM_LOG_LEVEL 0
+#endif
+
 namespace cm
 {
 
+inline constexpr LogLevel kMinLogLevel = static_cast<LogLevel>(CM_LOG_LEVEL);
+
+/**
+ * Token bucket for log_rate_limited(): up to burst lines at once, refilled at per_second lines per second.
+ */
+struct RateLimit {
+    double per_second { 1.0 };
+    uint32_t burst { 10 };
+};
+
+enum class LogMode {
+    // One formatted line per call.
+    Text,
+    // Format string ids and raw arguments, formatting happens offline with decode_binary_log().
+    Binary,
+};
+
 namespace detail {
 
-std::ostream* write_stream();
+bool logger_enabled() noexcept;
+
+LogMode logger_mode() noexcept;
+
+/**
+ * The calling thread's scratch buffer for formatting a line or encoding a record.
+ */
+fmt::memory_buffer& line_buffer();
+
+/**
+ * Queue a formatted line or an encoded record on the calling thread's ring, or count it as dropped when the ring is full. Never blocks.
+ */
+void write_line(std::string_view line) noexcept;
+
+/**
+ * The id of a format string in the binary log, its definition is written ahead of the first record using it.
+ * Keyed by the address of the string, so this only takes a lock the first time a thread logs from a call site.
+ */
+uint32_t format_id(std::string_view format, LogLevel level);
+
+/**
+ * State of one rate limited or sampled call site.
+ */
+struct LogSite {
+    // Set when the site is created, for the summaries the writer thread logs on its own.
+    std::string_view format {};
+    LogLevel level { LogLevel::Info };
+
+    std::atomic_uint64_t count { 0 };
+    std::atomic_uint64_t suppressed { 0 };
+    // steady_clock nanoseconds of the first line suppressed since the last summary.
+    std::atomic_int64_t suppressed_since_ns { 0 };
+    // Generic cell rate algorithm: the time the bucket is full again, one atomic instead of tokens and a refill time.
+    std::atomic_int64_t full_at_ns { 0 };
+
+    bool try_acquire(RateLimit limit) noexcept
+    {
+        auto interval = static_cast<int64_t>(1e9 / limit.per_second);
+        auto tolerance = interval * static_cast<int64_t>(std::max(limit.burst, uint32_t(1)) - 1);
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        int64_t full_at = full_at_ns.load(std::memory_order_relaxed);
+        for (;;) {
+            int64_t start = std::max(full_at, now);
+            if (start - now > tolerance)
+                return false;
+
+            if (full_at_ns.compare_exchange_weak(full_at, start + interval, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    void suppress() noexcept
+    {
+        if (suppressed.fetch_add(1, std::memory_order_relaxed) == 0) {
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            suppressed_since_ns.store(now, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * The site of a format string, keyed by its address like format_id(). level is the one of the call that creates it.
+ */
+LogSite& log_site(std::string_view format, LogLevel level);
+
+template <LogLevel Level, typename... T>
+void log(fmt::format_string<T...> fmt, T&&... args) {
+    if constexpr (Level >= kMinLogLevel) {
+        if (!logger_enabled())
+            return;
+
+        auto now = std::chrono::system_clock::now();
+        auto& buffer = line_buffer();
+        buffer.clear();
 
+        if (logger_mode() == LogMode::Binary) {
+            auto format = fmt::string_view(fmt);
+            binary_log::encode_event(buffer, format_id(std::string_view(format.data(), format.size()), Level), now, args...);
+        } else {
+            fmt::format_to(fmt::appender(buffer), "[{:%H:%M:%S}] ", now);
+            fmt::format_to(fmt::appender(buffer), fmt, std::forward<T>(args)...);
+            buffer.push_back('\n');
+        }
+
+        write_line(std::string_view(buffer.data(), buffer.size()));
+    }
 }
 
-void init_logger(const char* filename);
+template <LogLevel Level, typename... T>
+void log_sampled(LogSite& site, fmt::format_string<T...> fmt, T&&... args) {
+    log<Level>(fmt, std::forward<T>(args)...);
+
+    if (uint64_t suppressed = site.suppressed.exchange(0, std::memory_order_relaxed)) {
+        auto format = fmt::string_view(fmt);
+        log<Level>("[Logger] suppressed {} more like \"{}\"", suppressed, std::string_view(format.data(), format.size()));
+    }
+}
+
+}
+
+struct LoggerStats {
+    uint64_t bytes_written { 0 };
+    // Lines lost to a full ring, to a thread that could not get a ring within the memory budget, or binary records too large for a ring.
+    uint64_t lines_dropped { 0 };
+};
+
+/**
+ * Start logging to filename, next to the executable, or to stdout if filename is null.
+ * Lines are queued on a per-thread ring and written in batches by a background thread, so cm::log() never waits on the output.
+ * Lines from different threads are only ordered within a thread, the timestamps tell the rest.
+ */
+void init_logger(const char* filename, LogMode mode = LogMode::Text);
+
+/**
+ * Write out every line queued so far, and the count of every sampled or rate limited line not reported yet, blocking until done. Also runs at exit.
+ */
+void flush_logger();
+
+LoggerStats logger_stats();
+
+/**
+ * Log the first of every n calls from this call site, and how many were skipped since the previous one.
+ * Skipped lines that no later call reports within a second are reported by the writer thread.
+ */
+template <LogLevel Level = LogLevel::Info, typename... T>
+void log_every_n(uint64_t n, fmt::format_string<T...> fmt, T&&... args) {
+    if constexpr (Level >= kMinLogLevel) {
+        if (!detail::logger_enabled())
+            return;
+
+        auto format = fmt::string_view(fmt);
+        auto& site = detail::log_site(std::string_view(format.data(), format.size()), Level);
+        if (site.count.fetch_add(1, std::memory_order_relaxed) % std::max(n, uint64_t(1)) != 0) {
+            site.suppress();
+            return;
+        }
+
+        detail::log_sampled<Level>(site, fmt, std::forward<T>(args)...);
+    }
+}
+
+/**
+ * Log through a token bucket shared by every call to this call site, so an error storm costs a counter increment per call.
+ * The next line that gets through is followed by the number of lines suppressed before it.
+ * When none gets through within a second, e.g. at the end of the storm, the writer thread logs that number instead.
+ */
+template <LogLevel Level = LogLevel::Info, typename... T>
+void log_rate_limited(RateLimit limit, fmt::format_string<T...> fmt, T&&... args) {
+    if constexpr (Level >= kMinLogLevel) {
+        if (!detail::logger_enabled())
+            return;
+
+        auto format = fmt::string_view(fmt);
+        auto& site = detail::log_site(std::string_view(format.data(), format.size()), Level);
+        if (!site.try_acquire(limit)) {
+            site.suppress();
+            return;
+        }
+
+        detail::log_sampled<Level>(site, fmt, std::forward<T>(args)...);
+    }
+}
 
+template <typename... T>
+void log_trace(fmt::format_string<T...> fmt, T&&... args) {
+    detail::log<LogLevel::Trace>(fmt, std::forward<T>(args)...);
+}
+
+template <typename... T>
+void log_debug(fmt::format_string<T...> fmt, T&&... args) {
+    detail::log<LogLevel::Debug>(fmt, std::forward<T>(args)...);
+}
+
+/**
+ * Log at LogLevel::Info.
+ */
 template <typename... T>
 void log(fmt::format_string<T...> fmt, T&&... args) {
-    auto* write_stream = detail::write_stream();
-    if (write_stream) {
-        auto now =  std::chrono::system_clock::now();
-        auto formatted = fmt::format(fmt, std::forward<T>(args)...);
-        *write_stream << fmt::format("[{:%H:%M:%S}] {}\n", now, formatted);
-        write_stream->flush();
-    }
+    detail::log<LogLevel::Info>(fmt, std::forward<T>(args)...);
+}
+
+template <typename... T>
+void log_warn(fmt::format_string<T...> fmt, T&&... args) {
+    detail::log<LogLevel::Warn>(fmt, std::forward<T>(args)...);
+}
+
+template <typename... T>
+void log_error(fmt::format_string<T...> fmt, T&&... args) {
+    detail::log<LogLevel::Error>(fmt, std::forward<T>(args)...);
 }
 
 }
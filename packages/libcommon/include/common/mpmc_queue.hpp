@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace cm {
+
+/**
+ * Bounded multi-producer multi-consumer queue over a ring buffer (Dmitry Vyukov's design).
+ * Every slot carries a sequence number, producers and consumers only contend on one atomic index each, and no operation allocates.
+ * try_push() fails instead of blocking when the ring is full.
+ */
+template<typename T>
+class MpmcQueue {
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two.
+     */
+    explicit MpmcQueue(size_t capacity)
+        : m_mask(std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1)
+        , m_cells(std::make_unique<Cell[]>(m_mask + 1))
+    {
+        for (size_t i = 0; i <= m_mask; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue()
+    {
+        T value;
+        while (try_pop(value)) {
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    [[nodiscard]] size_t capacity() const noexcept { return m_mask + 1; }
+
+    /**
+     * @return false if the queue is full, value is left untouched in that case.
+     */
+    bool try_push(T& value)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        ::new (static_cast<void*>(cell->storage)) T(std::move(value));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return false if the queue is empty.
+     */
+    bool try_pop(T& value)
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* stored = std::launder(reinterpret_cast<T*>(cell->storage));
+        value = std::move(*stored);
+        stored->~T();
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic_size_t sequence { 0 };
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    alignas(64) std::atomic_size_t m_enqueue_pos { 0 };
+    alignas(64) std::atomic_size_t m_dequeue_pos { 0 };
+};
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace cm {
+
+/**
+ * Unbounded multi-producer single-consumer queue over a linked list (Dmitry Vyukov's design).
+ * push() takes no lock and never waits on another thread: one allocation, one exchange and one store.
+ * Items pushed from one thread are popped in the order they were pushed.
+ *
+ * try_pop() must only ever be called from one thread at a time. It can miss a push that is halfway done,
+ * so whoever wakes the consumer must do it after push() returns.
+ */
+template<typename T>
+class MpscQueue {
+public:
+    MpscQueue()
+        : m_head(new Node())
+        , m_tail(m_head.load(std::memory_order_relaxed))
+    {
+    }
+
+    ~MpscQueue()
+    {
+        while (m_tail) {
+            Node* next = m_tail->next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value)
+    {
+        auto* node = new Node();
+        node->value.emplace(std::move(value));
+
+        Node* previous = m_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @return false if the queue is empty, or the next push is not finished yet.
+     */
+    bool try_pop(T& value)
+    {
+        Node* next = m_tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        // The popped node becomes the new sentinel, its value moved out.
+        value = std::move(*next->value);
+        next->value.reset();
+
+        delete m_tail;
+        m_tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next { nullptr };
+        std::optional<T> value {};
+    };
+
+    alignas(64) std::atomic<Node*> m_head;
+    alignas(64) Node* m_tail;
+};
+
+/**
+ * Link of an IntrusiveMpscQueue, derive the queued type from it.
+ */
+struct MpscNode {
+    std::atomic<MpscNode*> next { nullptr };
+};
+
+/**
+ * MpscQueue for items that carry their own link, so pushing allocates nothing and an item can be one allocation with its payload.
+ * The queue never owns its items: try_pop() hands them back, and whatever is still queued when the queue is destroyed is leaked.
+ * Same threading rules as MpscQueue.
+ */
+class IntrusiveMpscQueue {
+public:
+    IntrusiveMpscQueue() = default;
+
+    IntrusiveMpscQueue(const IntrusiveMpscQueue&) = delete;
+    IntrusiveMpscQueue& operator=(const IntrusiveMpscQueue&) = delete;
+
+    void push(MpscNode* node) noexcept
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* previous = m_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @return nullptr if the queue is empty, or the next push is not finished yet.
+     */
+    MpscNode* try_pop() noexcept
+    {
+        MpscNode* tail = m_tail;
+        MpscNode* next = tail->next.load(std::memory_order_acquire);
+
+        // Step over the stub, it is only there so the list is never empty.
+        if (tail == &m_stub) {
+            if (!next)
+                return nullptr;
+
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        // tail is the last node, unless a push is halfway done.
+        if (tail != m_head.load(std::memory_order_acquire))
+            return nullptr;
+
+        // Put the stub back behind it, so tail can be handed out without leaving the list empty.
+        push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return nullptr;
+
+        m_tail = next;
+        return tail;
+    }
+
+private:
+    MpscNode m_stub {};
+    alignas(64) std::atomic<MpscNode*> m_head { &m_stub };
+    alignas(64) MpscNode* m_tail { &m_stub };
+};
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace cm {
+
+/**
+ * Names an element of a SlotMap. The slot's generation changes when its element is erased,
+ * so a handle to an erased element stays dead even once the slot holds another one.
+ * A default constructed handle never names anything.
+ */
+struct SlotHandle {
+    uint32_t index { 0 };
+    uint32_t generation { 0 };
+
+    friend bool operator==(const SlotHandle&, const SlotHandle&) = default;
+};
+
+/**
+ * Elements addressed by generation-checked handles. Insert, lookup and erase are O(1),
+ * erased slots are reused through a free list and elements never move while they live.
+ *
+ * Not thread safe, the owner provides locking.
+ */
+template<typename T>
+class SlotMap {
+public:
+    [[nodiscard]] size_t size() const noexcept { return m_size; }
+    [[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+
+    SlotHandle insert(T value)
+    {
+        uint32_t index = 0;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else {
+            index = uint32_t(m_slots.size());
+            m_slots.emplace_back();
+        }
+
+        auto& slot = m_slots[index];
+        slot.value.emplace(std::move(value));
+        m_size++;
+
+        return SlotHandle { index, slot.generation };
+    }
+
+    /**
+     * @return nullptr if the element was erased.
+     */
+    [[nodiscard]] T* get(SlotHandle handle) noexcept
+    {
+        if (handle.index >= m_slots.size())
+            return nullptr;
+
+        auto& slot = m_slots[handle.index];
+        if (slot.generation != handle.generation || !slot.value)
+            return nullptr;
+
+        return &*slot.value;
+    }
+
+    /**
+     * @return The erased element, for the caller to destroy once its own bookkeeping is done. std::nullopt if it was already erased.
+     */
+    std::optional<T> erase(SlotHandle handle)
+    {
+        if (!get(handle))
+            return std::nullopt;
+
+        auto& slot = m_slots[handle.index];
+        std::optional<T> value = std::move(slot.value);
+        release(slot, handle.index);
+        return value;
+    }
+
+    /**
+     * Erase every element. Handles given out so far all go dead.
+     */
+    void clear()
+    {
+        // Moved out first: destroying an element may look the map up again.
+        std::vector<T> values {};
+        values.reserve(m_size);
+        for (uint32_t i = 0; i < m_slots.size(); i++) {
+            auto& slot = m_slots[i];
+            if (!slot.value)
+                continue;
+
+            values.push_back(std::move(*slot.value));
+            release(slot, i);
+        }
+    }
+
+    template<typename F>
+    void for_each(F&& f)
+    {
+        for (uint32_t i = 0; i < m_slots.size(); i++) {
+            auto& slot = m_slots[i];
+            if (slot.value)
+                f(SlotHandle { i, slot.generation }, *slot.value);
+        }
+    }
+
+private:
+    struct Slot {
+        // Starts at 1, generation 0 is left to default constructed handles.
+        uint32_t generation { 1 };
+        std::optional<T> value {};
+    };
+
+    void release(Slot& slot, uint32_t index)
+    {
+        slot.value.reset();
+        if (++slot.generation == 0)
+            slot.generation = 1;
+
+        m_free.push_back(index);
+        m_size--;
+    }
+
+private:
+    std::vector<Slot> m_slots {};
+    std::vector<uint32_t> m_free {};
+    size_t m_size { 0 };
+};
+
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <type_traits>
+#include <utility>
+
+#include "./executor.hpp"
+
+namespace cm {
+
+/**
+ * A serial lane on top of a shared Executor.
+ * Tasks pushed to the same Strand run one at a time and in push order, while different Strands run in parallel on the executor's workers.
+ * Copies of a Strand share the same lane.
+ *
+ * The strand does not own its executor, which must outlive every copy of the strand and every task and timer pushed to it.
+ * Owning it would let a queued drain or a never cancelled timer hold the last reference, and destroy the executor from one of its own threads.
+ */
+class Strand {
+public:
+    explicit Strand(Executor& executor)
+        : m_state(std::make_shared<State>(executor))
+    {
+    }
+
+    [[nodiscard]] Executor& executor() const noexcept { return m_state->executor; }
+
+    /**
+     * Push a function with zero or more arguments, but no return value, to the back of this strand.
+     *
+     * @param task The function to push.
+     * @param args The zero or more arguments to pass to the function.
+     */
+    template<typename F, typename... A>
+    void push_task(F&& task, A&&... args)
+    {
+        enqueue(detail::bind_task(std::forward<F>(task), std::forward<A>(args)...));
+    }
+
+    /**
+     * Same as Executor::push_batch(): every task is queued under one lock, and the strand costs the executor at most one push.
+     */
+    template<typename Range>
+    void push_batch(Range&& tasks)
+    {
+        {
+            const std::scoped_lock lock(m_state->mutex);
+            for (auto&& task : tasks) {
+                if constexpr (std::is_lvalue_reference_v<Range>) {
+                    m_state->tasks.emplace(task);
+                } else {
+                    m_state->tasks.emplace(std::move(task));
+                }
+            }
+
+            if (m_state->scheduled || m_state->tasks.empty())
+                return;
+
+            m_state->scheduled = true;
+        }
+
+        schedule(m_state);
+    }
+
+    /**
+     * Submit a function with zero or more arguments to the back of this strand.
+     *
+     * @return A future to be used later to wait for the function to finish executing and/or obtain its returned value if it has one.
+     */
+    template<typename F, typename... A, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...>>
+    [[nodiscard]] std::future<R> submit(F&& task, A&&... args)
+    {
+        std::promise<R> task_promise;
+        auto future = task_promise.get_future();
+        push_task(
+            [task_function = detail::bind_task(std::forward<F>(task), std::forward<A>(args)...), task_promise = std::move(task_promise)]() mutable {
+                detail::fulfil_promise(task_promise, task_function);
+            });
+
+        return future;
+    }
+
+    /**
+     * Same as Executor::schedule_after(), but the task runs on this strand.
+     */
+    template<typename F>
+    TimerId schedule_after(std::chrono::milliseconds delay, F&& task)
+    {
+        return executor().add_timer(delay, make_timer(std::forward<F>(task), std::chrono::milliseconds::zero()));
+    }
+
+    /**
+     * Same as Executor::schedule_every(), but the task runs on this strand.
+     */
+    template<typename F>
+    TimerId schedule_every(std::chrono::milliseconds period, F&& task, std::optional<std::chrono::milliseconds> phase_jitter = std::nullopt)
+    {
+        return executor().add_timer(period + Executor::random_phase(phase_jitter.value_or(period)), make_timer(std::forward<F>(task), period));
+    }
+
+    bool cancel_timer(TimerId id)
+    {
+        return executor().cancel_timer(id);
+    }
+
+private:
+    using Task = Executor::Task;
+
+    // Upper bound of tasks run per executor turn, so one busy strand can not starve the others.
+    static constexpr size_t kMaxTasksPerTurn = 16;
+
+    struct State {
+        explicit State(Executor& executor)
+            : executor(executor)
+        {
+        }
+
+        Executor& executor;
+
+        std::mutex mutex {};
+        std::queue<Task> tasks {};
+        bool scheduled { false };
+    };
+
+    void enqueue(Task task)
+    {
+        enqueue(m_state, std::move(task));
+    }
+
+    static void enqueue(const std::shared_ptr<State>& state, Task task)
+    {
+        if (auto drain = enqueue_deferred(state, std::move(task)))
+            state->executor.enqueue(std::move(drain));
+    }
+
+    /**
+     * Queue a task without touching the executor.
+     *
+     * @return The drain to push to the executor if the strand was idle, empty otherwise.
+     */
+    static Task enqueue_deferred(const std::shared_ptr<State>& state, Task task)
+    {
+        {
+            const std::scoped_lock lock(state->mutex);
+            state->tasks.push(std::move(task));
+            if (state->scheduled)
+                return nullptr;
+
+            state->scheduled = true;
+        }
+
+        return [state]() { drain(state); };
+    }
+
+    template<typename F>
+    std::shared_ptr<Executor::Timer> make_timer(F&& task, std::chrono::milliseconds period)
+    {
+        auto timer = std::make_shared<Executor::Timer>(std::forward<F>(task), period);
+        timer->dispatch = [state = m_state](const std::shared_ptr<Executor::Timer>& timer) {
+            return enqueue_deferred(state, [timer]() { timer->run(); });
+        };
+
+        return timer;
+    }
+
+    static void schedule(const std::shared_ptr<State>& state)
+    {
+        state->executor.push_task([state]() { drain(state); });
+    }
+
+    static void drain(const std::shared_ptr<State>& state)
+    {
+        Task task;
+        for (size_t i = 0; i < kMaxTasksPerTurn; i++) {
+            {
+                const std::scoped_lock lock(state->mutex);
+                if (state->tasks.empty()) {
+                    state->scheduled = false;
+                    return;
+                }
+
+                task = std::move(state->tasks.front());
+                state->tasks.pop();
+            }
+
+            Executor::run_task(task);
+        }
+
+        // Still scheduled, hand the rest of the queue back to the executor.
+        schedule(state);
+    }
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "./executor.hpp"
+#include "./strand.hpp"
+#include "./unique_function.hpp"
+
+namespace cm {
+
+/**
+ * Where a coroutine continues after an asynchronous operation completes: an Executor, a Strand, or inline on whatever thread completed it.
+ * Task<> propagates its scheduler to the tasks it awaits, so a coroutine spawned on a Strand never leaves that strand.
+ */
+class Scheduler {
+public:
+    Scheduler() = default;
+
+    Scheduler(Executor& executor)
+        : m_target(&executor)
+    {
+    }
+
+    Scheduler(Strand strand)
+        : m_target(std::move(strand))
+    {
+    }
+
+    void resume(std::coroutine_handle<> handle)
+    {
+        if (auto* executor = std::get_if<Executor*>(&m_target)) {
+            (*executor)->push_task([handle]() { handle.resume(); });
+        } else if (auto* strand = std::get_if<Strand>(&m_target)) {
+            strand->push_task([handle]() { handle.resume(); });
+        } else {
+            handle.resume();
+        }
+    }
+
+private:
+    std::variant<std::monostate, Executor*, Strand> m_target {};
+};
+
+namespace detail {
+
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template<typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+    {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept { }
+};
+
+struct TaskPromiseBase {
+    Scheduler scheduler {};
+    std::coroutine_handle<> continuation {};
+    std::exception_ptr exception {};
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+};
+
+template<typename P>
+Scheduler scheduler_of(std::coroutine_handle<P> handle)
+{
+    if constexpr (std::is_base_of_v<TaskPromiseBase, P>) {
+        return handle.promise().scheduler;
+    } else {
+        return Scheduler {};
+    }
+}
+
+template<typename Promise>
+struct TaskAwaiter {
+    std::coroutine_handle<Promise> handle;
+
+    bool await_ready() noexcept { return false; }
+
+    template<typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept
+    {
+        handle.promise().continuation = caller;
+        handle.promise().scheduler = scheduler_of(caller);
+        return handle;
+    }
+
+    decltype(auto) await_resume() { return handle.promise().take(); }
+};
+
+struct ResumeOnAwaiter {
+    Scheduler scheduler;
+
+    bool await_ready() noexcept { return false; }
+
+    template<typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+    {
+        if constexpr (std::is_base_of_v<TaskPromiseBase, P>)
+            handle.promise().scheduler = scheduler;
+
+        scheduler.resume(handle);
+    }
+
+    void await_resume() noexcept { }
+};
+
+}
+
+/**
+ * A lazily started coroutine returning T.
+ * Nothing runs until the task is co_await-ed by another coroutine or handed to spawn().
+ */
+template<typename T = void>
+class [[nodiscard]] Task {
+public:
+    struct promise_type : detail::TaskPromiseBase {
+        std::optional<T> value {};
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        template<typename U>
+        void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+        T take()
+        {
+            if (exception)
+                std::rethrow_exception(exception);
+
+            return std::move(*value);
+        }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+    {
+    }
+
+    Task(Task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        return detail::TaskAwaiter<promise_type> { m_handle };
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template<>
+struct Task<void>::promise_type : detail::TaskPromiseBase {
+    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+    void return_void() { }
+
+    void take()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+/**
+ * Await a callback based operation.
+ * The operation is started when the coroutine suspends and receives a callback to call exactly once with either an exception or a result.
+ * The coroutine then continues on its scheduler.
+ */
+template<typename T>
+class [[nodiscard]] Async {
+public:
+    using Callback = UniqueFunction<void(std::exception_ptr, T)>;
+
+    explicit Async(UniqueFunction<void(Callback)> start)
+        : m_start(std::move(start))
+    {
+    }
+
+    /**
+     * Start the operation outside of a coroutine, callback gets what co_await would have returned or thrown.
+     */
+    void start(Callback callback) &&
+    {
+        auto start = std::move(m_start);
+        start(std::move(callback));
+    }
+
+    bool await_ready() noexcept { return false; }
+
+    template<typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+    {
+        // The callback may resume the coroutine, and destroy this awaiter, before start() returns.
+        auto start = std::move(m_start);
+        start([this, handle, scheduler = detail::scheduler_of(handle)](std::exception_ptr exception, T result) mutable {
+            m_exception = std::move(exception);
+            if (!m_exception)
+                m_result.emplace(std::move(result));
+
+            scheduler.resume(handle);
+        });
+    }
+
+    T await_resume()
+    {
+        if (m_exception)
+            std::rethrow_exception(m_exception);
+
+        return std::move(*m_result);
+    }
+
+private:
+    UniqueFunction<void(Callback)> m_start;
+    std::exception_ptr m_exception {};
+    std::optional<T> m_result {};
+};
+
+namespace detail {
+
+template<typename T>
+struct StartedState {
+    std::mutex mutex {};
+    bool done { false };
+    std::exception_ptr exception {};
+    std::optional<T> result {};
+    std::coroutine_handle<> waiter {};
+    Scheduler scheduler {};
+};
+
+}
+
+/**
+ * An Async operation already in flight, to be awaited later.
+ * Lets a coroutine issue independent operations back to back, then wait for each one when it needs the result.
+ * Await it at most once. Dropping it leaves the operation running and discards the result.
+ */
+template<typename T>
+class [[nodiscard]] Started {
+public:
+    explicit Started(Async<T> operation)
+        : m_state(std::make_shared<detail::StartedState<T>>())
+    {
+        std::move(operation).start([state = m_state](std::exception_ptr exception, T result) {
+            std::coroutine_handle<> waiter;
+            {
+                std::scoped_lock lk(state->mutex);
+                state->exception = std::move(exception);
+                if (!state->exception)
+                    state->result.emplace(std::move(result));
+
+                state->done = true;
+                waiter = std::exchange(state->waiter, nullptr);
+            }
+
+            if (waiter)
+                state->scheduler.resume(waiter);
+        });
+    }
+
+    bool await_ready()
+    {
+        std::scoped_lock lk(m_state->mutex);
+        return m_state->done;
+    }
+
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> handle)
+    {
+        std::scoped_lock lk(m_state->mutex);
+        if (m_state->done)
+            return false;
+
+        m_state->waiter = handle;
+        m_state->scheduler = detail::scheduler_of(handle);
+        return true;
+    }
+
+    T await_resume()
+    {
+        if (m_state->exception)
+            std::rethrow_exception(m_state->exception);
+
+        return std::move(*m_state->result);
+    }
+
+private:
+    std::shared_ptr<detail::StartedState<T>> m_state;
+};
+
+/**
+ * Start an Async operation now instead of when it is awaited.
+ */
+template<typename T>
+Started<T> start(Async<T> operation)
+{
+    return Started<T>(std::move(operation));
+}
+
+/**
+ * Continue the current coroutine on another scheduler, and keep it as the coroutine's scheduler from then on.
+ */
+inline detail::ResumeOnAwaiter resume_on(Scheduler scheduler)
+{
+    return detail::ResumeOnAwaiter { std::move(scheduler) };
+}
+
+namespace detail {
+
+struct DetachedTask {
+    struct promise_type : TaskPromiseBase {
+        DetachedTask get_return_object() { return DetachedTask { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() { }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename T>
+DetachedTask run_detached(Task<T> task, std::promise<T> promise)
+{
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.set_value();
+        } else {
+            promise.set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+}
+
+/**
+ * Start a task on a scheduler without waiting for it.
+ *
+ * @return A future for the task's result, it can be dropped without blocking.
+ */
+template<typename T>
+std::future<T> spawn(Scheduler scheduler, Task<T> task)
+{
+    std::promise<T> promise;
+    auto future = promise.get_future();
+
+    auto detached = detail::run_detached(std::move(task), std::move(promise));
+    detached.handle.promise().scheduler = scheduler;
+    scheduler.resume(detached.handle);
+
+    return future;
+}
+
+}
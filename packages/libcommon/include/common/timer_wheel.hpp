@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cm {
+
+using TimerId = uint64_t;
+
+/**
+ * Hierarchical timer wheel over abstract ticks, 4 levels of 64 slots.
+ * Scheduling and cancelling are O(1), advancing costs one slot per tick plus the occasional cascade of a higher level slot.
+ * Deadlines beyond 64^4 ticks are parked in the last level and re-placed every time they cascade.
+ *
+ * Not thread safe, the owner provides locking and decides what a tick means.
+ */
+template<typename T>
+class TimerWheel {
+public:
+    explicit TimerWheel(uint64_t current_tick = 0)
+        : m_current_tick(current_tick)
+    {
+    }
+
+    [[nodiscard]] uint64_t current_tick() const noexcept { return m_current_tick; }
+    [[nodiscard]] size_t size() const noexcept { return m_live.size(); }
+    [[nodiscard]] bool empty() const noexcept { return m_live.empty(); }
+
+    /**
+     * Schedule value to expire at expiry_tick, a deadline that already passed expires on the next tick.
+     * Scheduling an id that is still pending replaces it.
+     */
+    void schedule(TimerId id, uint64_t expiry_tick, T value)
+    {
+        if (expiry_tick <= m_current_tick)
+            expiry_tick = m_current_tick + 1;
+
+        m_live.insert_or_assign(id, Pending { expiry_tick, std::move(value) });
+        place(Entry { id, expiry_tick });
+    }
+
+    /**
+     * @return The value of the timer if it was still pending.
+     */
+    std::optional<T> cancel(TimerId id)
+    {
+        auto it = m_live.find(id);
+        if (it == m_live.end())
+            return std::nullopt;
+
+        // The slot entry stays behind and is skipped when its slot comes up.
+        T value = std::move(it->second.value);
+        m_live.erase(it);
+        return value;
+    }
+
+    /**
+     * The earliest tick at which advance() can have work to do, it may wake up early but never late.
+     */
+    [[nodiscard]] std::optional<uint64_t> next_expiry() const
+    {
+        if (m_live.empty())
+            return std::nullopt;
+
+        for (uint64_t tick = m_current_tick + 1; tick % kSlots != 0; tick++) {
+            if (!m_slots[0][tick % kSlots].empty())
+                return tick;
+        }
+
+        // Nothing in the first level before the next cascade.
+        return (m_current_tick / kSlots + 1) * kSlots;
+    }
+
+    /**
+     * Move the wheel forward to tick, calling on_expired(TimerId, T&&) for every timer that expired on the way.
+     * on_expired may schedule new timers.
+     */
+    template<typename F>
+    void advance(uint64_t tick, F&& on_expired)
+    {
+        while (m_current_tick < tick) {
+            if (m_live.empty()) {
+                m_current_tick = tick;
+                return;
+            }
+
+            m_current_tick++;
+            cascade();
+
+            auto expired = std::move(m_slots[0][m_current_tick % kSlots]);
+            m_slots[0][m_current_tick % kSlots].clear();
+
+            for (const auto& entry : expired) {
+                auto it = m_live.find(entry.id);
+                if (it == m_live.end() || it->second.expiry_tick != entry.expiry_tick)
+                    continue;
+
+                T value = std::move(it->second.value);
+                m_live.erase(it);
+                on_expired(entry.id, std::move(value));
+            }
+        }
+    }
+
+private:
+    static constexpr uint64_t kLevelBits = 6;
+    static constexpr uint64_t kSlots = uint64_t(1) << kLevelBits;
+    static constexpr size_t kLevels = 4;
+    static constexpr uint64_t kRange = uint64_t(1) << (kLevelBits * kLevels);
+
+    struct Entry {
+        TimerId id;
+        uint64_t expiry_tick;
+    };
+
+    struct Pending {
+        uint64_t expiry_tick;
+        T value;
+    };
+
+    void place(const Entry& entry)
+    {
+        uint64_t delta = entry.expiry_tick - m_current_tick;
+        uint64_t expiry_tick = delta < kRange ? entry.expiry_tick : m_current_tick + kRange - 1;
+
+        size_t level = 0;
+        while (level + 1 < kLevels && delta >= (uint64_t(1) << (kLevelBits * (level + 1))))
+            level++;
+
+        m_slots[level][(expiry_tick >> (kLevelBits * level)) % kSlots].push_back(entry);
+    }
+
+    void cascade()
+    {
+        // Highest level first, so entries can trickle down more than one level in the same tick.
+        for (size_t level = kLevels - 1; level > 0; level--) {
+            if (m_current_tick % (uint64_t(1) << (kLevelBits * level)) != 0)
+                continue;
+
+            auto& slot = m_slots[level][(m_current_tick >> (kLevelBits * level)) % kSlots];
+            auto entries = std::move(slot);
+            slot.clear();
+
+            for (const auto& entry : entries) {
+                auto it = m_live.find(entry.id);
+                if (it != m_live.end() && it->second.expiry_tick == entry.expiry_tick)
+                    place(entry);
+            }
+        }
+    }
+
+private:
+    uint64_t m_current_tick;
+    std::array<std::array<std::vector<Entry>, kSlots>, kLevels> m_slots {};
+    std::unordered_map<TimerId, Pending> m_live {};
+};
+
+}
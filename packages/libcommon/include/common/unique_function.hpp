@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cm {
+
+template<typename Signature>
+class UniqueFunction;
+
+/**
+ * A move-only replacement for std::function.
+ * Callables up to kInlineSize bytes that are nothrow move constructible are stored inline, so wrapping them never allocates.
+ * Bigger callables fall back to a single heap allocation.
+ */
+template<typename R, typename... Args>
+class UniqueFunction<R(Args...)> {
+public:
+    static constexpr size_t kInlineSize = 56;
+
+    UniqueFunction() noexcept = default;
+    UniqueFunction(std::nullptr_t) noexcept { }
+
+    template<typename F, typename Fn = std::decay_t<F>>
+        requires(!std::is_same_v<Fn, UniqueFunction> && std::is_invocable_r_v<R, Fn&, Args...>)
+    UniqueFunction(F&& fn)
+    {
+        if constexpr (stored_inline<Fn>()) {
+            ::new (static_cast<void*>(m_storage)) Fn(std::forward<F>(fn));
+            m_vtable = &kInlineVTable<Fn>;
+        } else {
+            ::new (static_cast<void*>(m_storage)) Fn*(new Fn(std::forward<F>(fn)));
+            m_vtable = &kHeapVTable<Fn>;
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept
+    {
+        move_from(other);
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+
+        return *this;
+    }
+
+    UniqueFunction& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+
+    ~UniqueFunction()
+    {
+        reset();
+    }
+
+    explicit operator bool() const noexcept { return m_vtable != nullptr; }
+
+    R operator()(Args... args)
+    {
+        if (!m_vtable)
+            throw std::bad_function_call();
+
+        return m_vtable->invoke(m_storage, std::forward<Args>(args)...);
+    }
+
+private:
+    struct VTable {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Fn>
+    static constexpr bool stored_inline()
+    {
+        return sizeof(Fn) <= kInlineSize
+            && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template<typename Fn>
+    static constexpr VTable kInlineVTable {
+        .invoke = [](void* storage, Args&&... args) -> R {
+            return std::invoke(*std::launder(static_cast<Fn*>(storage)), std::forward<Args>(args)...);
+        },
+        .move = [](void* dst, void* src) noexcept {
+            Fn* src_fn = std::launder(static_cast<Fn*>(src));
+            ::new (dst) Fn(std::move(*src_fn));
+            src_fn->~Fn();
+        },
+        .destroy = [](void* storage) noexcept {
+            std::launder(static_cast<Fn*>(storage))->~Fn();
+        },
+    };
+
+    template<typename Fn>
+    static constexpr VTable kHeapVTable {
+        .invoke = [](void* storage, Args&&... args) -> R {
+            return std::invoke(**static_cast<Fn**>(storage), std::forward<Args>(args)...);
+        },
+        .move = [](void* dst, void* src) noexcept {
+            ::new (dst) Fn*(*static_cast<Fn**>(src));
+        },
+        .destroy = [](void* storage) noexcept {
+            delete *static_cast<Fn**>(storage);
+        },
+    };
+
+    void move_from(UniqueFunction& other) noexcept
+    {
+        if (!other.m_vtable)
+            return;
+
+        other.m_vtable->move(m_storage, other.m_storage);
+        m_vtable = std::exchange(other.m_vtable, nullptr);
+    }
+
+    void reset() noexcept
+    {
+        if (m_vtable) {
+            m_vtable->destroy(m_storage);
+            m_vtable = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+    const VTable* m_vtable { nullptr };
+};
+
+}
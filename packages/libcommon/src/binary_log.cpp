@@ -0,0 +1,215 @@
+#include "common/binary_log.hpp"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <fmt/args.h>
+#include <fmt/chrono.h>
+
+namespace cm {
+
+namespace {
+
+struct Definition {
+    LogLevel level;
+    std::string format;
+};
+
+/**
+ * Bounds checked reads over one record's payload.
+ */
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : m_data(data)
+    {
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return m_data.empty(); }
+
+    template<typename V>
+    bool get(V& value)
+    {
+        if (m_data.size() < sizeof(V))
+            return false;
+
+        std::memcpy(&value, m_data.data(), sizeof(V));
+        m_data.remove_prefix(sizeof(V));
+        return true;
+    }
+
+    bool get_string(std::string_view& value)
+    {
+        uint32_t size;
+        if (!get(size) || m_data.size() < size)
+            return false;
+
+        value = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return true;
+    }
+
+    std::string_view rest()
+    {
+        return std::exchange(m_data, std::string_view());
+    }
+
+private:
+    std::string_view m_data;
+};
+
+std::chrono::system_clock::time_point to_time_point(int64_t nanoseconds)
+{
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+}
+
+bool decode_args(Reader& reader, fmt::dynamic_format_arg_store<fmt::format_context>& args)
+{
+    while (!reader.empty()) {
+        binary_log::ArgType type;
+        if (!reader.get(type))
+            return false;
+
+        bool ok = false;
+        switch (type) {
+        case binary_log::ArgType::Bool: {
+            bool value;
+            if ((ok = reader.get(value)))
+                args.push_back(value);
+            break;
+        }
+        case binary_log::ArgType::Char: {
+            char value;
+            if ((ok = reader.get(value)))
+                args.push_back(value);
+            break;
+        }
+        case binary_log::ArgType::Int: {
+            int64_t value;
+            if ((ok = reader.get(value)))
+                args.push_back(value);
+            break;
+        }
+        case binary_log::ArgType::UInt: {
+            uint64_t value;
+            if ((ok = reader.get(value)))
+                args.push_back(value);
+            break;
+        }
+        case binary_log::ArgType::Double: {
+            double value;
+            if ((ok = reader.get(value)))
+                args.push_back(value);
+            break;
+        }
+        case binary_log::ArgType::String: {
+            std::string_view value;
+            if ((ok = reader.get_string(value)))
+                args.push_back(std::string(value));
+            break;
+        }
+        case binary_log::ArgType::Pointer: {
+            uint64_t value;
+            if ((ok = reader.get(value)))
+                args.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(value)));
+            break;
+        }
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+bool decode_binary_log(std::istream& input, std::ostream& output, LogLevel min_level)
+{
+    std::string magic(binary_log::kMagic.size(), '\0');
+    if (!input.read(magic.data(), static_cast<std::streamsize>(magic.size())) || magic != binary_log::kMagic)
+        return false;
+
+    std::unordered_map<uint32_t, Definition> definitions;
+    std::string payload;
+    fmt::memory_buffer line;
+
+    for (;;) {
+        binary_log::RecordType type;
+        uint32_t size;
+        if (!input.read(reinterpret_cast<char*>(&type), sizeof(type)) || !input.read(reinterpret_cast<char*>(&size), sizeof(size)))
+            break;
+
+        payload.resize(size);
+        if (!input.read(payload.data(), static_cast<std::streamsize>(size)))
+            break;
+
+        Reader reader(payload);
+        line.clear();
+
+        switch (type) {
+        case binary_log::RecordType::Definition: {
+            uint32_t id;
+            LogLevel level;
+            if (reader.get(id) && reader.get(level))
+                definitions.insert_or_assign(id, Definition { level, std::string(reader.rest()) });
+            break;
+        }
+        case binary_log::RecordType::Event: {
+            uint32_t id;
+            int64_t timestamp;
+            if (!reader.get(id) || !reader.get(timestamp)) {
+                fmt::format_to(fmt::appender(line), "[Decoder] malformed event\n");
+                break;
+            }
+
+            auto definition = definitions.find(id);
+            if (definition == definitions.end()) {
+                fmt::format_to(fmt::appender(line), "[{:%H:%M:%S}] [Decoder] unknown format id {}\n", to_time_point(timestamp), id);
+                break;
+            }
+
+            if (definition->second.level < min_level)
+                break;
+
+            fmt::format_to(fmt::appender(line), "[{:%H:%M:%S}] ", to_time_point(timestamp));
+
+            fmt::dynamic_format_arg_store<fmt::format_context> args;
+            if (!decode_args(reader, args)) {
+                fmt::format_to(fmt::appender(line), "[Decoder] malformed arguments for \"{}\"\n", definition->second.format);
+                break;
+            }
+
+            try {
+                fmt::vformat_to(fmt::appender(line), definition->second.format, args);
+            } catch (const fmt::format_error& ex) {
+                fmt::format_to(fmt::appender(line), "[Decoder] {} in \"{}\"", ex.what(), definition->second.format);
+            }
+
+            line.push_back('\n');
+            break;
+        }
+        case binary_log::RecordType::Dropped: {
+            int64_t timestamp;
+            uint64_t count;
+            if (reader.get(timestamp) && reader.get(count))
+                fmt::format_to(fmt::appender(line), "[{:%H:%M:%S}] [Logger] dropped {} line(s)\n", to_time_point(timestamp), count);
+            break;
+        }
+        default:
+            // Unknown record types are skipped, the size prefix keeps the stream in sync.
+            break;
+        }
+
+        output.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+
+    output.flush();
+    return true;
+}
+
+}
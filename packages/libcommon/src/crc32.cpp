@@ -1,9 +1,29 @@
 #include "common/crc32.hpp"
 
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CM_CRC32_X86_64 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CM_CRC32_TARGET(features)
+#else
+#include <cpuid.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define CM_CRC32_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
 namespace cm {
 
 namespace {
 
+// Castagnoli polynomial, reflected.
+constexpr uint32_t kPolynomial = 0x82F63B78;
+
 constexpr uint32_t crc32_table[] = {
     0x00000000L, 0xF26B8303L, 0xE13B70F7L, 0x1350F3F4L,
     0xC79A971FL, 0x35F1141CL, 0x26A1E7E8L, 0xD4CA64EBL,
@@ -71,14 +91,233 @@ constexpr uint32_t crc32_table[] = {
     0xBE2DA0A5L, 0x4C4623A6L, 0x5F16D052L, 0xAD7D5351L
 };
 
+using Slices = std::array<std::array<uint32_t, 256>, 8>;
+
+/**
+ * slices[k][b] is the CRC of byte b followed by k zero bytes, so 8 bytes can be folded with 8 independent lookups.
+ */
+constexpr Slices make_slices()
+{
+    Slices slices {};
+    for (size_t i = 0; i < 256; i++) {
+        slices[0][i] = crc32_table[i];
+    }
+
+    for (size_t k = 1; k < slices.size(); k++) {
+        for (size_t i = 0; i < 256; i++) {
+            uint32_t prev = slices[k - 1][i];
+            slices[k][i] = (prev >> 8) ^ crc32_table[prev & 0xFF];
+        }
+    }
+
+    return slices;
 }
 
-void CRC32::update(const void* data, size_t size)
+constexpr Slices crc32_slices = make_slices();
+
+uint32_t update_bytes(uint32_t state, const uint8_t* data, size_t size)
 {
-    const uint8_t* u8_data = reinterpret_cast<const uint8_t*>(data);
     for (size_t i = 0; i < size; ++i) {
-        m_state = crc32_table[(m_state ^ u8_data[i]) & 0xFF] ^ (m_state >> 8);
+        state = crc32_table[(state ^ data[i]) & 0xFF] ^ (state >> 8);
+    }
+
+    return state;
+}
+
+uint32_t update_slicing_by_8(uint32_t state, const uint8_t* data, size_t size)
+{
+    if constexpr (std::endian::native == std::endian::little) {
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            word ^= state;
+
+            state = crc32_slices[7][word & 0xFF]
+                ^ crc32_slices[6][(word >> 8) & 0xFF]
+                ^ crc32_slices[5][(word >> 16) & 0xFF]
+                ^ crc32_slices[4][(word >> 24) & 0xFF]
+                ^ crc32_slices[3][(word >> 32) & 0xFF]
+                ^ crc32_slices[2][(word >> 40) & 0xFF]
+                ^ crc32_slices[1][(word >> 48) & 0xFF]
+                ^ crc32_slices[0][word >> 56];
+        }
+    }
+
+    return update_bytes(state, data, size);
+}
+
+#if CM_CRC32_X86_64
+
+/**
+ * a * b mod P, both polynomials in reflected form.
+ */
+constexpr uint32_t multiply_mod_p(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t bit = uint32_t(1) << 31; bit != 0; bit >>= 1) {
+        if (a & bit)
+            product ^= b;
+
+        b = (b & 1) ? (b >> 1) ^ kPolynomial : b >> 1;
+    }
+
+    return product;
+}
+
+/**
+ * x^exponent mod P, in reflected form.
+ */
+constexpr uint32_t x_pow_mod_p(uint64_t exponent)
+{
+    uint32_t result = uint32_t(1) << 31;
+    uint32_t square = uint32_t(1) << 30;
+    for (; exponent != 0; exponent >>= 1) {
+        if (exponent & 1)
+            result = multiply_mod_p(result, square);
+
+        square = multiply_mod_p(square, square);
+    }
+
+    return result;
+}
+
+/**
+ * Per stream block sizes of the 3-way interleaved loop, largest first. Each block has its own pair of shift constants.
+ * The crc32 instruction has a latency of 3 cycles and a throughput of 1, three independent streams keep it busy.
+ */
+constexpr std::array<size_t, 3> kBlockSizes = { 4096, 512, 64 };
+
+struct ShiftConstants {
+    // x^(8n - 33) mod P for n = 2 * block and n = block: carry-less multiplying a CRC by it and reducing with crc32
+    // yields the CRC shifted over n zero bytes.
+    uint64_t two_blocks;
+    uint64_t one_block;
+};
+
+constexpr std::array<ShiftConstants, kBlockSizes.size()> make_shift_constants()
+{
+    std::array<ShiftConstants, kBlockSizes.size()> constants {};
+    for (size_t i = 0; i < kBlockSizes.size(); i++) {
+        constants[i] = ShiftConstants {
+            .two_blocks = x_pow_mod_p(8 * 2 * kBlockSizes[i] - 33),
+            .one_block = x_pow_mod_p(8 * kBlockSizes[i] - 33),
+        };
+    }
+
+    return constants;
+}
+
+constexpr auto kShiftConstants = make_shift_constants();
+
+CM_CRC32_TARGET("sse4.2")
+uint32_t update_sse42(uint32_t state, const uint8_t* data, size_t size)
+{
+    uint64_t state64 = state;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state64 = _mm_crc32_u64(state64, word);
     }
+
+    state = static_cast<uint32_t>(state64);
+    for (; size > 0; data++, size--) {
+        state = _mm_crc32_u8(state, *data);
+    }
+
+    return state;
+}
+
+CM_CRC32_TARGET("sse4.2,pclmul")
+uint32_t shift(uint32_t crc, uint64_t constant)
+{
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)), _mm_cvtsi64_si128(static_cast<int64_t>(constant)), 0x00);
+    return static_cast<uint32_t>(_mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+CM_CRC32_TARGET("sse4.2,pclmul")
+uint32_t update_sse42_pclmul(uint32_t state, const uint8_t* data, size_t size)
+{
+    for (size_t tier = 0; tier < kBlockSizes.size(); tier++) {
+        const size_t block = kBlockSizes[tier];
+        for (; size >= 3 * block; data += 3 * block, size -= 3 * block) {
+            uint64_t crc0 = state;
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+
+            for (size_t offset = 0; offset < block; offset += 8) {
+                uint64_t word0, word1, word2;
+                std::memcpy(&word0, data + offset, sizeof(word0));
+                std::memcpy(&word1, data + block + offset, sizeof(word1));
+                std::memcpy(&word2, data + 2 * block + offset, sizeof(word2));
+
+                crc0 = _mm_crc32_u64(crc0, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+            }
+
+            // Fold the streams together: crc(A|B|C) = crc(A) * x^2n ^ crc(B) * x^n ^ crc(C)
+            state = shift(static_cast<uint32_t>(crc0), kShiftConstants[tier].two_blocks)
+                ^ shift(static_cast<uint32_t>(crc1), kShiftConstants[tier].one_block)
+                ^ static_cast<uint32_t>(crc2);
+        }
+    }
+
+    return update_sse42(state, data, size);
+}
+
+struct CpuFeatures {
+    bool sse42 { false };
+    bool pclmul { false };
+};
+
+CpuFeatures cpu_features()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4] {};
+    __cpuid(info, 1);
+    auto ecx = static_cast<uint32_t>(info[2]);
+#else
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return {};
+#endif
+
+    return CpuFeatures {
+        .sse42 = (ecx & (1u << 20)) != 0,
+        .pclmul = (ecx & (1u << 1)) != 0,
+    };
+}
+
+#endif
+
+struct Implementation {
+    uint32_t (*update)(uint32_t state, const uint8_t* data, size_t size);
+    std::string_view name;
+};
+
+const Implementation& implementation()
+{
+    // Picked once, on first use.
+    static const Implementation s_implementation = []() -> Implementation {
+#if CM_CRC32_X86_64
+        auto features = cpu_features();
+        if (features.sse42 && features.pclmul)
+            return { update_sse42_pclmul, "sse4.2+pclmul" };
+
+        if (features.sse42)
+            return { update_sse42, "sse4.2" };
+#endif
+        return { update_slicing_by_8, "slicing-by-8" };
+    }();
+
+    return s_implementation;
+}
+
+}
+
+void CRC32::update(const void* data, size_t size)
+{
+    m_state = implementation().update(m_state, reinterpret_cast<const uint8_t*>(data), size);
 }
 
 uint32_t CRC32::digest() const
@@ -86,4 +325,9 @@ uint32_t CRC32::digest() const
     return m_state ^ 0xFFFFFFFF;
 }
 
-}
\ No newline at end of file
+std::string_view CRC32::implementation_name()
+{
+    return implementation().name;
+}
+
+}
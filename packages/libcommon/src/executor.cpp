@@ -0,0 +1,509 @@
+#include "common/executor.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace cm {
+
+namespace {
+
+struct CurrentWorker {
+    const Executor* executor { nullptr };
+    size_t index { 0 };
+};
+
+thread_local CurrentWorker t_current_worker {};
+thread_local uint32_t t_tasks_pushed = 0;
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Reading the clock costs about as much as running a small task, so only a sample of the tasks is timed.
+ * @return The enqueue timestamp of the next task pushed by this thread, 0 if it is not sampled.
+ */
+uint64_t sample_enqueue_time(uint32_t sample_rate)
+{
+    return (++t_tasks_pushed % sample_rate) == 0 ? now_ns() : 0;
+}
+
+uint32_t next_random()
+{
+    // xorshift32, seeded once per thread
+    thread_local uint32_t s_state = std::random_device {}() | 1;
+
+    s_state ^= s_state << 13;
+    s_state ^= s_state >> 17;
+    s_state ^= s_state << 5;
+    return s_state;
+}
+
+}
+
+/**
+ * A worker's own queue in WorkStealing mode: a fixed ring used as a deque.
+ * The owner pushes and pops at the back, thieves take from the front.
+ */
+struct alignas(64) Executor::Worker {
+    std::mutex mutex {};
+    std::unique_ptr<Job[]> jobs { std::make_unique<Job[]>(kWorkerQueueCapacity) };
+    size_t head { 0 };
+    size_t size { 0 };
+    std::thread thread {};
+
+    // Only written by the worker's own thread, so recording never contends. Kept off the cache line thieves lock.
+    alignas(64) Histogram wait_time {};
+    Histogram run_time {};
+    std::atomic_uint64_t tasks_executed { 0 };
+    std::atomic_uint64_t idle_ns { 0 };
+    std::atomic_uint64_t parked_since { 0 };
+
+    bool push_back(Job& job)
+    {
+        if (size == kWorkerQueueCapacity)
+            return false;
+
+        jobs[(head + size) % kWorkerQueueCapacity] = std::move(job);
+        size++;
+        return true;
+    }
+
+    bool pop_back(Job& job)
+    {
+        if (size == 0)
+            return false;
+
+        size--;
+        job = std::move(jobs[(head + size) % kWorkerQueueCapacity]);
+        return true;
+    }
+
+    bool pop_front(Job& job)
+    {
+        if (size == 0)
+            return false;
+
+        job = std::move(jobs[head]);
+        head = (head + 1) % kWorkerQueueCapacity;
+        size--;
+        return true;
+    }
+
+    void record(const Job& job, uint64_t started_at, uint64_t finished_at)
+    {
+        wait_time.record_exclusive(started_at > job.enqueued_at ? (started_at - job.enqueued_at) / 1000 : 0);
+        run_time.record_exclusive((finished_at - started_at) / 1000);
+    }
+
+    void park_begin(uint64_t now)
+    {
+        parked_since.store(now, std::memory_order_relaxed);
+    }
+
+    void park_end(uint64_t now)
+    {
+        idle_ns.store(idle_ns.load(std::memory_order_relaxed) + (now - parked_since.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        parked_since.store(0, std::memory_order_relaxed);
+    }
+};
+
+Executor::Executor(size_t num_concurrency, Mode mode)
+    : m_mode(mode)
+{
+    m_workers.reserve(num_concurrency);
+    for (size_t i = 0; i < num_concurrency; i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    for (size_t i = 0; i < num_concurrency; i++) {
+        m_workers[i]->thread = std::thread(&Executor::worker, this, i);
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        const std::scoped_lock timer_lock(m_timer_mutex);
+        m_timers_running = false;
+    }
+    m_timer_cv.notify_all();
+
+    if (m_timer_thread.joinable())
+        m_timer_thread.join();
+
+    wait_for_tasks();
+
+    {
+        const std::scoped_lock park_lock(m_park_mutex);
+        m_workers_running = false;
+    }
+    m_task_available_cv.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void Executor::wait_for_tasks()
+{
+    std::unique_lock done_lock(m_done_mutex);
+    m_tasks_done_cv.wait(done_lock, [this] { return m_tasks_unfinished.load() == 0; });
+}
+
+void Executor::enqueue(Task task)
+{
+    Job job { .task = std::move(task), .enqueued_at = sample_enqueue_time(kMetricsSampleRate) };
+
+    // Count the task before it is visible, a worker must never see it without the matching counters.
+    m_tasks_unfinished.fetch_add(1);
+    m_tasks_queued.fetch_add(1);
+
+    bool pushed = false;
+    if (m_mode == Mode::WorkStealing && !m_workers.empty()) {
+        auto& worker = *m_workers[target_worker()];
+        const std::scoped_lock worker_lock(worker.mutex);
+        pushed = worker.push_back(job);
+    }
+
+    if (!pushed)
+        push_shared(job);
+
+    notify_parked();
+}
+
+void Executor::enqueue_batch(std::vector<Task>& tasks)
+{
+    if (tasks.empty())
+        return;
+
+    m_tasks_unfinished.fetch_add(tasks.size());
+    m_tasks_queued.fetch_add(tasks.size());
+
+    // The whole batch lands in one worker's deque, idle workers steal their share from it.
+    size_t pushed = 0;
+    if (m_mode == Mode::WorkStealing && !m_workers.empty()) {
+        auto& worker = *m_workers[target_worker()];
+        const std::scoped_lock worker_lock(worker.mutex);
+        for (; pushed < tasks.size(); pushed++) {
+            Job job { .task = std::move(tasks[pushed]), .enqueued_at = sample_enqueue_time(kMetricsSampleRate) };
+            if (!worker.push_back(job)) {
+                tasks[pushed] = std::move(job.task);
+                break;
+            }
+        }
+    }
+
+    for (size_t i = pushed; i < tasks.size(); i++) {
+        Job job { .task = std::move(tasks[i]), .enqueued_at = sample_enqueue_time(kMetricsSampleRate) };
+        push_shared(job);
+    }
+
+    notify_parked(tasks.size());
+}
+
+size_t Executor::target_worker()
+{
+    return t_current_worker.executor == this
+        ? t_current_worker.index
+        : m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+}
+
+void Executor::push_shared(Job& job)
+{
+    if (!m_overflowing.load(std::memory_order_acquire) && m_tasks.try_push(job))
+        return;
+
+    // Ring is full, keep FIFO order by routing every push through the overflow until it drains.
+    const std::scoped_lock overflow_lock(m_overflow_mutex);
+    if (!m_overflowing.load(std::memory_order_relaxed) && m_tasks.try_push(job))
+        return;
+
+    m_overflowing.store(true, std::memory_order_release);
+    m_overflow_tasks.push_back(std::move(job));
+}
+
+bool Executor::pop_shared(Job& job)
+{
+    if (m_tasks.try_pop(job))
+        return true;
+
+    if (!m_overflowing.load(std::memory_order_acquire))
+        return false;
+
+    const std::scoped_lock overflow_lock(m_overflow_mutex);
+    if (m_overflow_tasks.empty())
+        return false;
+
+    job = std::move(m_overflow_tasks.front());
+    m_overflow_tasks.pop_front();
+    if (m_overflow_tasks.empty())
+        m_overflowing.store(false, std::memory_order_release);
+
+    return true;
+}
+
+void Executor::notify_parked(size_t count)
+{
+    size_t parked = m_workers_parked.load();
+    if (parked == 0)
+        return;
+
+    // Taking the lock orders this notify after a worker that is about to park has started waiting.
+    { const std::scoped_lock park_lock(m_park_mutex); }
+    if (count >= parked) {
+        m_task_available_cv.notify_all();
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            m_task_available_cv.notify_one();
+        }
+    }
+}
+
+bool Executor::pop_task(size_t index, Job& job)
+{
+    if (m_mode == Mode::WorkStealing) {
+        auto& worker = *m_workers[index];
+        const std::scoped_lock worker_lock(worker.mutex);
+        if (worker.pop_back(job))
+            return true;
+    }
+
+    return pop_shared(job);
+}
+
+bool Executor::steal_task(size_t index, Job& job)
+{
+    if (m_mode != Mode::WorkStealing || m_workers.size() < 2)
+        return false;
+
+    // Start at a random victim, then sweep the rest so a queued task is never missed.
+    size_t count = m_workers.size();
+    size_t start = next_random() % count;
+    for (size_t i = 0; i < count; i++) {
+        size_t victim = (start + i) % count;
+        if (victim == index)
+            continue;
+
+        auto& worker = *m_workers[victim];
+        const std::unique_lock worker_lock(worker.mutex, std::try_to_lock);
+        if (worker_lock.owns_lock() && worker.pop_front(job))
+            return true;
+    }
+
+    return false;
+}
+
+void Executor::worker(size_t index)
+{
+    t_current_worker = CurrentWorker { .executor = this, .index = index };
+    auto& self = *m_workers[index];
+
+    Job job;
+    while (true) {
+        if (pop_task(index, job) || steal_task(index, job)) {
+            m_tasks_queued.fetch_sub(1);
+
+            bool timed = job.enqueued_at != 0;
+            uint64_t started_at = timed ? now_ns() : 0;
+            run_task(job.task);
+            job.task = nullptr;
+
+            if (timed)
+                self.record(job, started_at, now_ns());
+
+            self.tasks_executed.store(self.tasks_executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (m_tasks_unfinished.fetch_sub(1) == 1) {
+                { const std::scoped_lock done_lock(m_done_mutex); }
+                m_tasks_done_cv.notify_all();
+            }
+
+            continue;
+        }
+
+        std::unique_lock park_lock(m_park_mutex);
+        if (!m_workers_running)
+            break;
+
+        // A task may be counted but not yet pushed (or held by a busy victim), yield instead of parking.
+        if (m_tasks_queued.load() > 0) {
+            park_lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+
+        m_workers_parked.fetch_add(1);
+        self.park_begin(now_ns());
+        m_task_available_cv.wait(park_lock, [this] { return m_tasks_queued.load() > 0 || !m_workers_running; });
+        self.park_end(now_ns());
+        m_workers_parked.fetch_sub(1);
+    }
+
+    t_current_worker = CurrentWorker {};
+}
+
+TimerId Executor::add_timer(std::chrono::milliseconds delay, std::shared_ptr<Timer> timer)
+{
+    const std::scoped_lock timer_lock(m_timer_mutex);
+    if (!m_timer_thread.joinable())
+        m_timer_thread = std::thread(&Executor::timer_worker, this);
+
+    TimerId id = m_next_timer_id++;
+    // The wheel may lag behind the clock while the timer thread sleeps, count the delay from now,
+    // rounded up to the next tick so a timer never fires early.
+    m_timers.schedule(id, current_timer_tick() + delay.count() + 1, std::move(timer));
+    m_timer_cv.notify_one();
+
+    return id;
+}
+
+bool Executor::cancel_timer(TimerId id)
+{
+    const std::scoped_lock timer_lock(m_timer_mutex);
+    auto timer = m_timers.cancel(id);
+    if (!timer)
+        return false;
+
+    (*timer)->cancelled = true;
+    return true;
+}
+
+std::chrono::milliseconds Executor::random_phase(std::chrono::milliseconds phase_jitter)
+{
+    if (phase_jitter.count() <= 0)
+        return std::chrono::milliseconds::zero();
+
+    return std::chrono::milliseconds(next_random() % static_cast<uint64_t>(phase_jitter.count()));
+}
+
+uint64_t Executor::current_timer_tick() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void Executor::timer_worker()
+{
+    std::vector<std::shared_ptr<Timer>> expired;
+    std::vector<Task> ready;
+
+    std::unique_lock timer_lock(m_timer_mutex);
+    while (m_timers_running) {
+        m_timers.advance(current_timer_tick(), [&](TimerId id, std::shared_ptr<Timer>&& timer) {
+            if (timer->period.count() > 0)
+                m_timers.schedule(id, m_timers.current_tick() + timer->period.count(), timer);
+
+            expired.push_back(std::move(timer));
+        });
+
+        if (!expired.empty()) {
+            timer_lock.unlock();
+            for (auto& timer : expired) {
+                if (timer->queued.exchange(true))
+                    continue;
+
+                if (!timer->dispatch) {
+                    ready.emplace_back([timer = std::move(timer)]() { timer->run(); });
+                } else if (auto task = timer->dispatch(timer)) {
+                    ready.push_back(std::move(task));
+                }
+            }
+
+            // Thousands of periodic timers can expire in the same tick, push them with one lock and one wake-up.
+            enqueue_batch(ready);
+            ready.clear();
+            expired.clear();
+            timer_lock.lock();
+            continue;
+        }
+
+        auto next_tick = m_timers.next_expiry();
+        if (!next_tick) {
+            m_timer_cv.wait(timer_lock);
+        } else {
+            m_timer_cv.wait_until(timer_lock, m_epoch + std::chrono::milliseconds(*next_tick));
+        }
+    }
+}
+
+Executor::Metrics Executor::metrics() const
+{
+    uint64_t now = now_ns();
+
+    Metrics ret;
+    ret.uptime = std::chrono::steady_clock::now() - m_epoch;
+    ret.queue_depth = m_tasks_queued.load(std::memory_order_relaxed);
+    ret.workers.reserve(m_workers.size());
+
+    for (const auto& worker : m_workers) {
+        // Busy is whatever is not parked, including the park that is still going on.
+        uint64_t idle_ns = worker->idle_ns.load(std::memory_order_relaxed);
+        uint64_t parked_since = worker->parked_since.load(std::memory_order_relaxed);
+        if (parked_since != 0 && now > parked_since)
+            idle_ns += now - parked_since;
+
+        auto idle_time = std::chrono::nanoseconds(idle_ns);
+        Metrics::WorkerMetrics worker_metrics {
+            .tasks_executed = worker->tasks_executed.load(std::memory_order_relaxed),
+            .busy_time = ret.uptime > idle_time ? ret.uptime - idle_time : std::chrono::nanoseconds::zero(),
+        };
+
+        ret.tasks_executed += worker_metrics.tasks_executed;
+        ret.wait_time.merge(worker->wait_time.snapshot());
+        ret.run_time.merge(worker->run_time.snapshot());
+        ret.workers.push_back(worker_metrics);
+    }
+
+    return ret;
+}
+
+double Executor::Metrics::busy_ratio(size_t worker) const
+{
+    if (worker >= workers.size() || uptime.count() <= 0)
+        return 0.0;
+
+    return std::min(1.0, double(workers[worker].busy_time.count()) / double(uptime.count()));
+}
+
+double Executor::Metrics::tasks_per_second() const
+{
+    if (uptime.count() <= 0)
+        return 0.0;
+
+    return double(tasks_executed) / std::chrono::duration<double>(uptime).count();
+}
+
+Executor::Metrics Executor::Metrics::since(const Metrics& previous) const
+{
+    Metrics ret = *this;
+    ret.uptime = uptime - previous.uptime;
+    ret.tasks_executed = tasks_executed - previous.tasks_executed;
+    ret.wait_time = wait_time.since(previous.wait_time);
+    ret.run_time = run_time.since(previous.run_time);
+
+    for (size_t i = 0; i < ret.workers.size() && i < previous.workers.size(); i++) {
+        ret.workers[i].tasks_executed -= previous.workers[i].tasks_executed;
+        ret.workers[i].busy_time -= previous.workers[i].busy_time;
+    }
+
+    return ret;
+}
+
+void Executor::run_task(Task& task)
+{
+    try {
+        task();
+    } catch (const std::exception& ex) {
+        cm::log_error("[Executor][ERROR] {}", ex.what());
+    } catch (const std::string& ex) {
+        cm::log_error("[Executor][ERROR] {}", ex);
+    } catch (const char* ex) {
+        cm::log_error("[Executor][ERROR] {}", ex);
+    } catch (...) {
+        cm::log_error("[Executor][ERROR] Unknown exception");
+    }
+}
+
+}
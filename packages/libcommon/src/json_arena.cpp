@@ -0,0 +1,55 @@
+#include "common/json_arena.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace cm {
+
+namespace detail {
+
+std::pmr::memory_resource*& current_json_resource() noexcept
+{
+    thread_local std::pmr::memory_resource* resource = nullptr;
+    return resource;
+}
+
+namespace {
+
+struct ArenaRegistry {
+    std::mutex mutex {};
+    std::unordered_set<const std::pmr::memory_resource*> alive {};
+};
+
+ArenaRegistry& arena_registry()
+{
+    // Never destroyed, arenas may be destroyed during static destruction.
+    static auto* registry = new ArenaRegistry();
+    return *registry;
+}
+
+}
+
+void register_json_arena(const std::pmr::memory_resource* resource)
+{
+    auto& registry = arena_registry();
+    const std::scoped_lock lock(registry.mutex);
+    registry.alive.insert(resource);
+}
+
+void unregister_json_arena(const std::pmr::memory_resource* resource) noexcept
+{
+    auto& registry = arena_registry();
+    const std::scoped_lock lock(registry.mutex);
+    registry.alive.erase(resource);
+}
+
+bool json_arena_alive(const std::pmr::memory_resource* resource) noexcept
+{
+    auto& registry = arena_registry();
+    const std::scoped_lock lock(registry.mutex);
+    return registry.alive.contains(resource);
+}
+
+}
+
+}
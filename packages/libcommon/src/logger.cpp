@@ -1,7 +1,19 @@
 #include "common/logger.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -12,39 +24,453 @@
 namespace cm
 {
 
-static std::ostream* s_output_stream;
+namespace {
+
+constexpr size_t kRingCapacity = size_t(64) << 10;
+constexpr size_t kMemoryBudget = size_t(8) << 20;
+constexpr size_t kMaxRings = kMemoryBudget / kRingCapacity;
+
+// Longer lines are cut, longer binary records dropped, so a single line can never take more than a quarter of a ring.
+constexpr size_t kMaxLineSize = kRingCapacity / 4;
+constexpr std::string_view kTruncatedSuffix = "...\n";
+
+constexpr auto kFlushInterval = std::chrono::milliseconds(20);
+
+// How long suppressed lines wait for the next line of their site to report them, before the writer does.
+constexpr auto kSuppressedReportDelay = std::chrono::seconds(1);
+constexpr std::string_view kSuppressedFormat = "[Logger] suppressed {} more like \"{}\"";
+
+/**
+ * Every rate limited or sampled call site. Sites live as long as the process, like the string literals they are keyed by.
+ */
+struct SiteRegistry {
+    std::mutex mutex {};
+    std::unordered_map<const char*, std::unique_ptr<detail::LogSite>> sites {};
+};
+
+SiteRegistry& site_registry()
+{
+    static auto* registry = new SiteRegistry();
+    return *registry;
+}
+
+/**
+ * Single producer, single consumer byte ring. Only whole lines are published, so the consumer can copy out any range between tail and head as is.
+ */
+struct Ring {
+    // Producer side.
+    alignas(64) std::atomic_uint64_t head { 0 };
+    uint64_t cached_tail { 0 };
+    std::atomic_uint64_t dropped { 0 };
+
+    // Consumer side.
+    alignas(64) std::atomic_uint64_t tail { 0 };
+
+    std::unique_ptr<char[]> data { std::make_unique<char[]>(kRingCapacity) };
+
+    /**
+     * @return The bytes in use after the push, 0 if the line was dropped.
+     */
+    size_t push(std::string_view text, std::string_view suffix) noexcept
+    {
+        size_t size = text.size() + suffix.size();
+        uint64_t write_pos = head.load(std::memory_order_relaxed);
+        if (kRingCapacity - (write_pos - cached_tail) < size) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (kRingCapacity - (write_pos - cached_tail) < size) {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return 0;
+            }
+        }
+
+        copy_in(write_pos, text);
+        copy_in(write_pos + text.size(), suffix);
+        head.store(write_pos + size, std::memory_order_release);
+        return write_pos + size - cached_tail;
+    }
+
+    void drain_into(std::string& out) noexcept
+    {
+        uint64_t read_pos = tail.load(std::memory_order_relaxed);
+        uint64_t write_pos = head.load(std::memory_order_acquire);
+        if (read_pos == write_pos)
+            return;
+
+        size_t begin = read_pos % kRingCapacity;
+        size_t size = write_pos - read_pos;
+        size_t first = std::min(size, kRingCapacity - begin);
+        out.append(data.get() + begin, first);
+        out.append(data.get(), size - first);
+        tail.store(write_pos, std::memory_order_release);
+    }
+
+private:
+    void copy_in(uint64_t pos, std::string_view bytes) noexcept
+    {
+        size_t begin = pos % kRingCapacity;
+        size_t first = std::min(bytes.size(), kRingCapacity - begin);
+        std::memcpy(data.get() + begin, bytes.data(), first);
+        std::memcpy(data.get(), bytes.data() + first, bytes.size() - first);
+    }
+};
+
+class Backend {
+public:
+    Backend(std::ostream* output, LogMode mode)
+        : m_output(output)
+        , m_mode(mode)
+    {
+        m_rings.reserve(kMaxRings);
+        std::thread([this]() { writer(); }).detach();
+    }
+
+    Ring* acquire_ring()
+    {
+        const std::scoped_lock lock(m_rings_mutex);
+        if (!m_free_rings.empty()) {
+            Ring* ring = m_free_rings.back();
+            m_free_rings.pop_back();
+            m_free_ring_count.store(m_free_rings.size(), std::memory_order_relaxed);
+            return ring;
+        }
+
+        if (m_rings.size() == kMaxRings)
+            return nullptr;
+
+        // Reserved up front and never shrunk, the writer can walk the first m_ring_count rings without the lock.
+        m_rings.push_back(std::make_unique<Ring>());
+        m_ring_count.store(m_rings.size(), std::memory_order_release);
+        return m_rings.back().get();
+    }
+
+    void release_ring(Ring* ring)
+    {
+        // Lines still queued stay there until the writer gets to them, whichever thread picks up the ring next.
+        const std::scoped_lock lock(m_rings_mutex);
+        m_free_rings.push_back(ring);
+        m_free_ring_count.store(m_free_rings.size(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Whether acquire_ring() may succeed, checked without the lock by threads that got no ring so far.
+     */
+    [[nodiscard]] bool ring_available() const noexcept
+    {
+        return m_free_ring_count.load(std::memory_order_relaxed) > 0 || m_ring_count.load(std::memory_order_relaxed) < kMaxRings;
+    }
+
+    void write_line(Ring* ring, std::string_view line) noexcept
+    {
+        if (ring == nullptr) {
+            m_dropped_before_ring.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::string_view suffix;
+        if (line.size() > kMaxLineSize) {
+            // A cut record would make the rest of a binary log unreadable.
+            if (m_mode == LogMode::Binary) {
+                m_dropped_before_ring.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            line = line.substr(0, kMaxLineSize - kTruncatedSuffix.size());
+            suffix = kTruncatedSuffix;
+        }
+
+        // Wake the writer early once a ring is half full, otherwise it comes by every kFlushInterval.
+        if (ring->push(line, suffix) > kRingCapacity / 2 && !m_wake_pending.exchange(true, std::memory_order_relaxed))
+            m_wake.notify_one();
+    }
+
+    [[nodiscard]] LogMode mode() const noexcept { return m_mode; }
+
+    uint32_t format_id(std::string_view format, LogLevel level)
+    {
+        const std::scoped_lock lock(m_definitions_mutex);
+        auto [it, inserted] = m_format_ids.try_emplace(format.data(), static_cast<uint32_t>(m_format_ids.size()));
+        if (inserted) {
+            fmt::memory_buffer record;
+            binary_log::put(record, binary_log::RecordType::Definition);
+            binary_log::put(record, static_cast<uint32_t>(sizeof(uint32_t) + sizeof(LogLevel) + format.size()));
+            binary_log::put(record, it->second);
+            binary_log::put(record, level);
+            record.append(format.data(), format.data() + format.size());
+            m_definitions.append(record.data(), record.size());
+        }
+
+        return it->second;
+    }
+
+    /**
+     * @param all_suppressed Report every suppressed count, not only those kSuppressedReportDelay old.
+     */
+    void flush(bool all_suppressed)
+    {
+        const std::scoped_lock lock(m_flush_mutex);
+
+        // Before the definitions are taken, binary summaries may add one.
+        fmt::memory_buffer summaries;
+        report_suppressed(summaries, all_suppressed);
+
+        size_t ring_count = m_ring_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < ring_count; i++) {
+            m_rings[i]->drain_into(m_batch);
+        }
+
+        if (m_mode == LogMode::Binary) {
+            // Taken after the rings, so it holds the definition of every event drained above and goes in front of them.
+            const std::scoped_lock definitions_lock(m_definitions_mutex);
+            m_batch.insert(0, m_definitions);
+            m_definitions.clear();
+        }
+
+        m_batch.append(summaries.data(), summaries.size());
+
+        uint64_t dropped = lines_dropped();
+        if (dropped != m_reported_dropped) {
+            auto now = std::chrono::system_clock::now();
+            if (m_mode == LogMode::Binary) {
+                fmt::memory_buffer record;
+                binary_log::put(record, binary_log::RecordType::Dropped);
+                binary_log::put(record, static_cast<uint32_t>(sizeof(int64_t) + sizeof(uint64_t)));
+                binary_log::put(record, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count()));
+                binary_log::put(record, dropped - m_reported_dropped);
+                m_batch.append(record.data(), record.size());
+            } else {
+                m_batch += fmt::format("[{:%H:%M:%S}] [Logger] dropped {} line(s)\n", now, dropped - m_reported_dropped);
+            }
+
+            m_reported_dropped = dropped;
+        }
+
+        if (m_batch.empty())
+            return;
+
+        m_output->write(m_batch.data(), static_cast<std::streamsize>(m_batch.size()));
+        m_output->flush();
+        m_bytes_written.fetch_add(m_batch.size(), std::memory_order_relaxed);
+        m_batch.clear();
+    }
+
+    LoggerStats stats() const
+    {
+        return LoggerStats {
+            .bytes_written = m_bytes_written.load(std::memory_order_relaxed),
+            .lines_dropped = lines_dropped(),
+        };
+    }
+
+private:
+    uint64_t lines_dropped() const
+    {
+        uint64_t dropped = m_dropped_before_ring.load(std::memory_order_relaxed);
+        size_t ring_count = m_ring_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < ring_count; i++) {
+            dropped += m_rings[i]->dropped.load(std::memory_order_relaxed);
+        }
+
+        return dropped;
+    }
+
+    /**
+     * The summaries of suppressed lines that no later line of their site reported, e.g. at the end of a storm.
+     */
+    void report_suppressed(fmt::memory_buffer& out, bool all)
+    {
+        auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        auto delay_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(kSuppressedReportDelay).count();
+        auto now = std::chrono::system_clock::now();
+
+        auto& registry = site_registry();
+        const std::scoped_lock lock(registry.mutex);
+        for (auto& [key, site] : registry.sites) {
+            if (site->suppressed.load(std::memory_order_relaxed) == 0)
+                continue;
+
+            if (!all && now_ns - site->suppressed_since_ns.load(std::memory_order_relaxed) < delay_ns)
+                continue;
+
+            uint64_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+            if (suppressed == 0)
+                continue;
+
+            if (m_mode == LogMode::Binary) {
+                binary_log::encode_event(out, format_id(kSuppressedFormat, site->level), now, suppressed, site->format);
+            } else {
+                fmt::format_to(fmt::appender(out), "[{:%H:%M:%S}] ", now);
+                fmt::format_to(fmt::appender(out), fmt::runtime(kSuppressedFormat), suppressed, site->format);
+                out.push_back('\n');
+            }
+        }
+    }
+
+    void writer()
+    {
+        for (;;) {
+            {
+                std::unique_lock lock(m_wake_mutex);
+                m_wake.wait_for(lock, kFlushInterval, [this]() { return m_wake_pending.load(std::memory_order_relaxed); });
+            }
+
+            m_wake_pending.store(false, std::memory_order_relaxed);
+            flush(false);
+        }
+    }
+
+private:
+    std::ostream* m_output;
+    LogMode m_mode;
+
+    std::mutex m_rings_mutex {};
+    std::vector<std::unique_ptr<Ring>> m_rings {};
+    std::vector<Ring*> m_free_rings {};
+    std::atomic_size_t m_ring_count { 0 };
+    std::atomic_size_t m_free_ring_count { 0 };
+    std::atomic_uint64_t m_dropped_before_ring { 0 };
+
+    std::mutex m_wake_mutex {};
+    std::condition_variable m_wake {};
+    std::atomic_bool m_wake_pending { false };
+
+    std::mutex m_definitions_mutex {};
+    std::unordered_map<const char*, uint32_t> m_format_ids {};
+    std::string m_definitions {};
+
+    std::mutex m_flush_mutex {};
+    std::string m_batch {};
+    uint64_t m_reported_dropped { 0 };
+    std::atomic_uint64_t m_bytes_written { 0 };
+};
+
+// Never destroyed: the writer thread is detached and threads may still log while the process exits.
+std::atomic<Backend*> s_backend { nullptr };
+
+struct ThreadRing {
+    Backend* backend { nullptr };
+    Ring* ring { nullptr };
+
+    ~ThreadRing()
+    {
+        if (ring != nullptr)
+            backend->release_ring(ring);
+    }
+};
+
+}
 
 namespace detail {
 
-std::ostream* write_stream()
+bool logger_enabled() noexcept
 {
-    return s_output_stream;
+    return s_backend.load(std::memory_order_acquire) != nullptr;
 }
 
+LogMode logger_mode() noexcept
+{
+    return s_backend.load(std::memory_order_relaxed)->mode();
 }
 
-void init_logger(const char* filename)
+fmt::memory_buffer& line_buffer()
 {
-    if (s_output_stream != nullptr)
-        return;
+    thread_local fmt::memory_buffer buffer;
+    return buffer;
+}
 
-    if (filename == nullptr) {
-        s_output_stream = &std::cout;
-        return;
+void write_line(std::string_view line) noexcept
+{
+    thread_local ThreadRing t_ring;
+    if (t_ring.backend == nullptr)
+        t_ring.backend = s_backend.load(std::memory_order_acquire);
+
+    // Every ring was taken, or allocating one failed: try again once another thread gave one back.
+    if (t_ring.ring == nullptr && t_ring.backend->ring_available()) {
+        try {
+            t_ring.ring = t_ring.backend->acquire_ring();
+        } catch (...) {
+        }
     }
 
-    std::string bin_path_string;
+    t_ring.backend->write_line(t_ring.ring, line);
+}
+
+LogSite& log_site(std::string_view format, LogLevel level)
+{
+    thread_local std::unordered_map<const char*, LogSite*> t_sites;
+    auto it = t_sites.find(format.data());
+    if (it != t_sites.end())
+        return *it->second;
+
+    auto& registry = site_registry();
+    LogSite* site;
+    {
+        const std::scoped_lock lock(registry.mutex);
+        auto& slot = registry.sites[format.data()];
+        if (!slot) {
+            slot = std::make_unique<LogSite>();
+            slot->format = format;
+            slot->level = level;
+        }
+
+        site = slot.get();
+    }
+
+    t_sites.emplace(format.data(), site);
+    return *site;
+}
+
+uint32_t format_id(std::string_view format, LogLevel level)
+{
+    thread_local std::unordered_map<const char*, uint32_t> t_format_ids;
+    auto it = t_format_ids.find(format.data());
+    if (it != t_format_ids.end())
+        return it->second;
+
+    uint32_t id = s_backend.load(std::memory_order_acquire)->format_id(format, level);
+    t_format_ids.emplace(format.data(), id);
+    return id;
+}
+
+}
+
+void init_logger(const char* filename, LogMode mode)
+{
+    if (s_backend.load(std::memory_order_acquire) != nullptr)
+        return;
+
+    std::ostream* output_stream = &std::cout;
+    if (filename != nullptr) {
+        std::string bin_path_string;
 #ifdef _WIN32
-    bin_path_string.resize(255, 0);
-    GetModuleFileName(NULL, bin_path_string.data(), bin_path_string.size());
+        bin_path_string.resize(255, 0);
+        GetModuleFileName(NULL, bin_path_string.data(), bin_path_string.size());
 #else
-    bin_path_string = std::filesystem::canonical("/proc/self/exe").string();
+        bin_path_string = std::filesystem::canonical("/proc/self/exe").string();
 #endif
 
-    std::filesystem::path bin_path(bin_path_string);
-    auto log_path = (bin_path.parent_path() / filename).string();
+        std::filesystem::path bin_path(bin_path_string);
+        auto log_path = (bin_path.parent_path() / filename).string();
 
-    s_output_stream = new std::ofstream(log_path.c_str());
+        output_stream = new std::ofstream(log_path.c_str(), mode == LogMode::Binary ? std::ios::out | std::ios::binary : std::ios::out);
+    }
+
+    if (mode == LogMode::Binary)
+        output_stream->write(binary_log::kMagic.data(), static_cast<std::streamsize>(binary_log::kMagic.size()));
+
+    s_backend.store(new Backend(output_stream, mode), std::memory_order_release);
+    std::atexit(flush_logger);
 }
 
-}
\ No newline at end of file
+void flush_logger()
+{
+    if (auto* backend = s_backend.load(std::memory_order_acquire))
+        backend->flush(true);
+}
+
+LoggerStats logger_stats()
+{
+    auto* backend = s_backend.load(std::memory_order_acquire);
+    return backend != nullptr ? backend->stats() : LoggerStats {};
+}
+
+}
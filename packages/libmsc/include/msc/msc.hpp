@@ -7,9 +7,12 @@
 #include <memory>
 #include <optional>
 #include <span>
+#include <stdexcept>
+#include <type_traits>
 
 #include <common/executor.hpp>
 #include <common/json.hpp>
+#include <common/slot_map.hpp>
 
 #ifdef _WIN32
 #    ifdef MSC_EXPORTS
@@ -51,21 +54,110 @@ struct EXPORT CreateTransportOptions {
     nlohmann::json sctp_parameters = nullptr;
 };
 
+namespace detail {
+
+/**
+ * Set the promise to error, or else to what f returns or throws.
+ */
+template<typename T, typename F>
+void fulfil(std::promise<T>& promise, std::exception_ptr error, F&& f)
+{
+    if (!error) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                f();
+                promise.set_value();
+            } else {
+                promise.set_value(f());
+            }
+
+            return;
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    promise.set_exception(error);
+}
+
+/**
+ * Run f now and hand its result, or what it threw, over as a ready future.
+ */
+template<typename F>
+std::future<std::invoke_result_t<F>> ready_future(F&& f) noexcept
+{
+    std::promise<std::invoke_result_t<F>> promise;
+    fulfil(promise, nullptr, std::forward<F>(f));
+    return promise.get_future();
+}
+
+}
+
+/**
+ * The future a DeviceDelegate returns, completed later from the callback that receives the server's answer.
+ * Copies share the same future, capture one in the callback.
+ */
+template<typename T>
+class Completion {
+public:
+    Completion()
+        : m_promise(std::make_shared<std::promise<T>>())
+    {
+    }
+
+    /**
+     * Call it once, before the future can complete.
+     */
+    std::future<T> future() { return m_promise->get_future(); }
+
+    /**
+     * Complete the future with error, or else with what read returns or throws. Call it once.
+     */
+    template<typename Read>
+    void complete(std::exception_ptr error, Read&& read) const
+    {
+        detail::fulfil(*m_promise, std::move(error), std::forward<Read>(read));
+    }
+
+private:
+    std::shared_ptr<std::promise<T>> m_promise;
+};
+
+/**
+ * Signaling for a Device. The _async methods return a future the delegate completes later,
+ * e.g. from the network callback that receives the answer, without blocking the thread it was called on.
+ * Producing also comes in a synchronous form that returns once the server answered, override one of the two:
+ * the _async defaults call the synchronous ones.
+ */
 class EXPORT DeviceDelegate {
 public:
     virtual ~DeviceDelegate() { }
 
     virtual CreateTransportOptions create_server_side_transport(TransportKind kind, const nlohmann::json& rtp_capabilities) = 0;
-    virtual void connect_transport(TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters) = 0;
 
-    virtual std::string connect_producer(const std::string& transport_id, MediaKind kind, const nlohmann::json& rtp_parameters)
+    virtual std::string connect_producer(const std::string&, MediaKind, const nlohmann::json&)
+    {
+        throw std::logic_error("not implemented");
+    }
+
+    virtual std::string connect_data_producer(const std::string&, const nlohmann::json&, const std::string&, const std::string&)
     {
-        throw std::exception("not implemented");
+        throw std::logic_error("not implemented");
     }
 
-    virtual std::string connect_data_producer(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol)
+    /**
+     * The arguments are only valid during the call, copy what the answer needs.
+     */
+    virtual std::future<void> connect_transport_async(TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters) = 0;
+
+    virtual std::future<std::string> connect_producer_async(const std::string& transport_id, MediaKind kind, const nlohmann::json& rtp_parameters)
     {
-        throw std::exception("not implemented");
+        return detail::ready_future([&]() { return connect_producer(transport_id, kind, rtp_parameters); });
+    }
+
+    virtual std::future<std::string> connect_data_producer_async(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol)
+    {
+        return detail::ready_future([&]() { return connect_data_producer(transport_id, sctp_parameters, label, protocol); });
     }
 
     virtual void on_connection_state_change(TransportKind kind, const std::string& transport_id, const std::string& connection_state) noexcept
@@ -195,12 +287,22 @@ public:
     virtual void send_data(std::span<const uint8_t>) = 0;
 };
 
+/**
+ * rtp_parameters converts from any basic_json, so it can be taken straight out of a cm::ArenaJson message,
+ * copying only that subtree out of the arena.
+ */
 struct EXPORT ConsumerOptions {
     std::string consumer_id;
     std::string producer_id;
     nlohmann::json rtp_parameters;
 };
 
+/**
+ * Names a sink created by a Device. It goes stale once the sink is closed, by the Device or by its transport,
+ * and closing a stale handle does nothing.
+ */
+using SinkHandle = cm::SlotHandle;
+
 struct EXPORT ProducerOptions {
     nlohmann::json encodings;
     nlohmann::json codec_options;
@@ -224,15 +326,15 @@ public:
 
     virtual void ensure_transport(TransportKind kind) noexcept = 0;
 
-    virtual void create_video_sink(
+    virtual SinkHandle create_video_sink(
         const ConsumerOptions&,
         std::shared_ptr<VideoConsumer> consumer = nullptr)
         = 0;
-    virtual void create_audio_sink(
+    virtual SinkHandle create_audio_sink(
         const ConsumerOptions&,
         std::shared_ptr<AudioConsumer> consumer = nullptr)
         = 0;
-    virtual void create_data_sink(
+    virtual SinkHandle create_data_sink(
         const std::string& consumer_id,
         const std::string& producer_id,
         uint16_t stream_id,
@@ -241,6 +343,9 @@ public:
         std::shared_ptr<DataConsumer> = nullptr)
         = 0;
 
+    virtual void close_sink(SinkHandle) noexcept = 0;
+
+    // Close a sink by the consumer it was created with, one of them if the consumer was given to several.
     virtual void close_video_sink(const std::shared_ptr<VideoConsumer>&) noexcept = 0;
     virtual void close_audio_sink(const std::shared_ptr<AudioConsumer>&) noexcept = 0;
     virtual void close_data_sink(const std::shared_ptr<DataConsumer>&) noexcept = 0;
@@ -0,0 +1,70 @@
+#include "capability_cache.hpp"
+
+#include <chrono>
+
+namespace msc
+{
+
+CapabilityCache& CapabilityCache::instance()
+{
+    // Leaked, devices may still be released by other static destructors.
+    static auto* cache = new CapabilityCache();
+    return *cache;
+}
+
+std::shared_ptr<mediasoupclient::Device> CapabilityCache::load(const nlohmann::json& router_rtp_capabilities, const mediasoupclient::PeerConnection::Options* options)
+{
+    size_t hash = std::hash<nlohmann::json> {}(router_rtp_capabilities);
+
+    std::promise<std::shared_ptr<mediasoupclient::Device>> promise;
+    {
+        std::unique_lock lk(m_mutex);
+        auto [begin, end] = m_entries.equal_range(hash);
+        for (auto it = begin; it != end; it++) {
+            if (it->second.router_rtp_capabilities == router_rtp_capabilities) {
+                auto future = it->second.device;
+                lk.unlock();
+                return future.get();
+            }
+        }
+
+        prune();
+        m_entries.emplace(hash, Entry { router_rtp_capabilities, promise.get_future().share() });
+    }
+
+    try {
+        auto device = std::make_shared<mediasoupclient::Device>();
+        device->Load(router_rtp_capabilities, options);
+        promise.set_value(device);
+        return device;
+    } catch (...) {
+        {
+            std::scoped_lock lk(m_mutex);
+            auto [begin, end] = m_entries.equal_range(hash);
+            for (auto it = begin; it != end; it++) {
+                if (it->second.router_rtp_capabilities == router_rtp_capabilities) {
+                    m_entries.erase(it);
+                    break;
+                }
+            }
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+void CapabilityCache::prune()
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        auto& device = it->second.device;
+        // The future holds the only reference left once every Device using it is gone.
+        if (device.wait_for(std::chrono::seconds(0)) == std::future_status::ready && device.get().use_count() == 1) {
+            it = m_entries.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <common/json.hpp>
+
+#include <Device.hpp>
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace msc
+{
+
+/**
+ * Loaded mediasoupclient devices, shared by every Device loaded with the same router capabilities.
+ * Loading is what costs: it opens a throwaway peer connection for the native capabilities and intersects them with the router's.
+ * Every peer connection factory is built with the same codecs, so the result only depends on the router capabilities.
+ *
+ * A shared device is immutable once loaded. Only use it for the const getters, CanProduce and creating transports,
+ * which read it and nothing else.
+ */
+class CapabilityCache
+{
+public:
+    static CapabilityCache& instance();
+
+    /**
+     * Find the device loaded for these capabilities, or load it.
+     * Concurrent loads of the same capabilities wait for the first one instead of repeating it.
+     *
+     * @param options Only used for the native capabilities probe on a miss.
+     * @throw What mediasoupclient::Device::Load throws, to every caller waiting for that load.
+     */
+    std::shared_ptr<mediasoupclient::Device> load(const nlohmann::json& router_rtp_capabilities, const mediasoupclient::PeerConnection::Options* options);
+
+private:
+    using DeviceFuture = std::shared_future<std::shared_ptr<mediasoupclient::Device>>;
+
+    struct Entry {
+        nlohmann::json router_rtp_capabilities;
+        DeviceFuture device;
+    };
+
+    // Drop loaded devices nobody uses anymore.
+    void prune();
+
+private:
+    std::mutex m_mutex;
+    std::unordered_multimap<size_t, Entry> m_entries {};
+};
+
+}
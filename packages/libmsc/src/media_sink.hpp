@@ -9,8 +9,8 @@ class SinkImpl {
 public:
     virtual ~SinkImpl() = default;
 
-    virtual bool is_consumer_equal(const mediasoupclient::Consumer*) = 0;
-    virtual bool is_user_ptr_equal(const void*) = 0;
+    virtual const mediasoupclient::Consumer* consumer() const = 0;
+    virtual const void* user_consumer() const = 0;
     virtual void on_close() = 0;
 };
 
@@ -41,14 +41,14 @@ public:
         size_t number_of_frames,
         absl::optional<int64_t> absolute_capture_timestamp_ms) override;
 
-    bool is_consumer_equal(const mediasoupclient::Consumer* consumer) override
+    const mediasoupclient::Consumer* consumer() const override
     {
-        return consumer == m_consumer.get();
+        return m_consumer.get();
     }
 
-    bool is_user_ptr_equal(const void* other) override
+    const void* user_consumer() const override
     {
-        return other == m_user_consumer.get();
+        return m_user_consumer.get();
     }
 
     void on_close() override
@@ -83,14 +83,14 @@ public:
 
     void OnFrame(const webrtc::VideoFrame& frame) override;
 
-    bool is_consumer_equal(const mediasoupclient::Consumer* consumer) override
+    const mediasoupclient::Consumer* consumer() const override
     {
-        return consumer == m_consumer.get();
+        return m_consumer.get();
     }
 
-    bool is_user_ptr_equal(const void* other) override
+    const void* user_consumer() const override
     {
-        return other == m_user_consumer.get();
+        return m_user_consumer.get();
     }
 
     void on_close() override
@@ -118,14 +118,14 @@ public:
         }
     }
 
-    bool is_consumer_equal(const mediasoupclient::DataConsumer* consumer)
+    const mediasoupclient::DataConsumer* consumer() const
     {
-        return consumer == m_consumer.get();
+        return m_consumer.get();
     }
 
-    bool is_user_ptr_equal(const void* ptr)
+    const void* user_consumer() const
     {
-        return ptr == m_user_consumer.get();
+        return m_user_consumer.get();
     }
 
     void set_consumer(std::unique_ptr<mediasoupclient::DataConsumer> consumer)
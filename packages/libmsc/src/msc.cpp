@@ -1,9 +1,11 @@
 #include "msc/msc.hpp"
 
+#include "./capability_cache.hpp"
 #include "./media_sender.hpp"
 #include "./media_sink.hpp"
 #include "./peer_connection_factory.hpp"
 #include "./serde.hpp"
+#include "./sink_registry.hpp"
 
 #include <variant>
 
@@ -26,9 +28,22 @@ const std::string kVideo = "video";
 
 class FFIMediasoupLogHandler : public mediasoupclient::Logger::LogHandlerInterface {
 public:
-    void OnLog(mediasoupclient::Logger::LogLevel, char* payload, size_t size) override
+    void OnLog(mediasoupclient::Logger::LogLevel level, char* payload, size_t size) override
     {
-        cm::log("[MS]{}", std::string_view(payload, size));
+        switch (level) {
+        case mediasoupclient::Logger::LogLevel::LOG_ERROR:
+            cm::log_error("[MS]{}", std::string_view(payload, size));
+            break;
+        case mediasoupclient::Logger::LogLevel::LOG_WARN:
+            cm::log_warn("[MS]{}", std::string_view(payload, size));
+            break;
+        case mediasoupclient::Logger::LogLevel::LOG_DEBUG:
+            cm::log_debug("[MS]{}", std::string_view(payload, size));
+            break;
+        default:
+            cm::log_trace("[MS]{}", std::string_view(payload, size));
+            break;
+        }
     }
 };
 
@@ -52,23 +67,23 @@ public:
 
     bool load(const nlohmann::json& rtp_capabilities) noexcept override
     {
-        if (m_device.IsLoaded())
+        if (m_device)
             return false;
 
         mediasoupclient::PeerConnection::Options options;
         options.factory = m_peer_connection_factory.get();
 
-        m_device.Load(rtp_capabilities, &options);
+        m_device = CapabilityCache::instance().load(rtp_capabilities, &options);
 
         return true;
     }
 
     const nlohmann::json& rtp_capabilities() const noexcept override
     {
-        if (!m_device.IsLoaded())
+        if (!m_device)
             return s_null_json;
 
-        return m_device.GetRtpCapabilities();
+        return m_device->GetRtpCapabilities();
     }
 
     void stop() noexcept override
@@ -85,21 +100,22 @@ public:
 
     bool can_produce(MediaKind kind) noexcept override
     {
-        if (!m_device.IsLoaded())
+        if (!m_device)
             return false;
 
-        return m_device.CanProduce(kind == MediaKind::Audio ? kAudio : kAudio);
+        return m_device->CanProduce(kind == MediaKind::Audio ? kAudio : kAudio);
     }
 
     void ensure_transport(TransportKind kind) noexcept override;
 
-    void create_video_sink(const ConsumerOptions&, std::shared_ptr<VideoConsumer> consumer) override;
-    void create_audio_sink(const ConsumerOptions&, std::shared_ptr<AudioConsumer> consumer) override;
-    void create_data_sink(const std::string& consumer_id, const std::string& producer_id, uint16_t stream_id, const std::string& label, const std::string& protocol, std::shared_ptr<DataConsumer>) override;
+    SinkHandle create_video_sink(const ConsumerOptions&, std::shared_ptr<VideoConsumer> consumer) override;
+    SinkHandle create_audio_sink(const ConsumerOptions&, std::shared_ptr<AudioConsumer> consumer) override;
+    SinkHandle create_data_sink(const std::string& consumer_id, const std::string& producer_id, uint16_t stream_id, const std::string& label, const std::string& protocol, std::shared_ptr<DataConsumer>) override;
 
-    void close_video_sink(const std::shared_ptr<VideoConsumer>& consumer) noexcept override { close_sink(consumer.get()); }
-    void close_audio_sink(const std::shared_ptr<AudioConsumer>& consumer) noexcept override { close_sink(consumer.get()); }
-    void close_data_sink(const std::shared_ptr<DataConsumer>&) noexcept override;
+    void close_sink(SinkHandle handle) noexcept override { on_sink_closed(m_sinks.erase(handle)); }
+    void close_video_sink(const std::shared_ptr<VideoConsumer>& consumer) noexcept override { on_sink_closed(m_sinks.erase_by_user_consumer(consumer.get())); }
+    void close_audio_sink(const std::shared_ptr<AudioConsumer>& consumer) noexcept override { on_sink_closed(m_sinks.erase_by_user_consumer(consumer.get())); }
+    void close_data_sink(const std::shared_ptr<DataConsumer>& consumer) noexcept override { on_sink_closed(m_sinks.erase_by_user_consumer(consumer.get())); }
 
     std::shared_ptr<VideoSender> create_video_source(const ProducerOptions&) override;
     std::shared_ptr<AudioSender> create_audio_source(const ProducerOptions&) override;
@@ -108,40 +124,32 @@ public:
     std::shared_ptr<void> re_encode(MediaKind, const ConsumerOptions&, const ProducerOptions&) override;
 
 private:
-    void close_sink(const void* consumer) noexcept;
+    // ensure_transport(), but throws when the transport could not be created, for callers that use it right after.
+    void require_transport(TransportKind kind);
+    // Tell the user consumer of a media sink taken out of the registry that it is closed, then destroy the sink.
+    void on_sink_closed(std::optional<SinkRegistry::Sink> sink) noexcept;
     void close_sender(const void* producer) noexcept;
 
 public:
+    // mediasoupclient waits for these futures itself, the delegate completes them from wherever the answer arrives.
     std::future<void> OnConnect(mediasoupclient::Transport* transport, const nlohmann::json& dtls_parameters) override
     {
-        m_delegate->connect_transport(
+        return m_delegate->connect_transport_async(
             transport == m_send_transport.get() ? TransportKind::Send : TransportKind::Recv,
             transport->GetId(),
             dtls_parameters);
-
-        std::promise<void> ret;
-        ret.set_value();
-        return ret.get_future();
     }
 
     std::future<std::string> OnProduce(mediasoupclient::SendTransport* transport, const std::string& kind, nlohmann::json rtp_parameters, const nlohmann::json& app_data) override
     {
         (void)app_data;
-        std::string producer_id = m_delegate->connect_producer(transport->GetId(), kind == kAudio ? MediaKind::Audio : MediaKind::Video, rtp_parameters);
-
-        std::promise<std::string> ret;
-        ret.set_value(std::move(producer_id));
-        return ret.get_future();
+        return m_delegate->connect_producer_async(transport->GetId(), kind == kAudio ? MediaKind::Audio : MediaKind::Video, rtp_parameters);
     }
 
     std::future<std::string> OnProduceData(mediasoupclient::SendTransport* transport, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol, const nlohmann::json& app_data) override
     {
         (void)app_data;
-        std::string producer_id = m_delegate->connect_data_producer(transport->GetId(), sctp_parameters, label, protocol);
-
-        std::promise<std::string> ret;
-        ret.set_value(std::move(producer_id));
-        return ret.get_future();
+        return m_delegate->connect_data_producer_async(transport->GetId(), sctp_parameters, label, protocol);
     }
 
     void OnTransportClose(mediasoupclient::Producer* producer) override { close_sender(producer); }
@@ -167,12 +175,12 @@ private:
     DeviceDelegate* m_delegate;
     rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> m_peer_connection_factory;
 
-    mediasoupclient::Device m_device {};
+    // Shared with every DeviceImpl loaded with the same router capabilities, see CapabilityCache.
+    std::shared_ptr<mediasoupclient::Device> m_device {};
     std::unique_ptr<mediasoupclient::SendTransport> m_send_transport { nullptr };
     std::unique_ptr<mediasoupclient::RecvTransport> m_recv_transport { nullptr };
 
-    std::vector<std::unique_ptr<SinkImpl>> m_sinks {};
-    std::vector<std::unique_ptr<DataConsumerImpl>> m_data_sinks {};
+    SinkRegistry m_sinks {};
 
     std::unordered_map<
         const void*,
@@ -191,6 +199,11 @@ void DeviceImpl::ensure_transport(TransportKind kind) noexcept
     if (kind == TransportKind::Recv && m_recv_transport)
         return;
 
+    if (!m_device) {
+        cm::log_error("[Device][ERROR] ensure_transport called before load");
+        return;
+    }
+
     auto transport_options = m_delegate->create_server_side_transport(kind, this->rtp_capabilities());
 
     mediasoupclient::PeerConnection::Options options;
@@ -199,7 +212,7 @@ void DeviceImpl::ensure_transport(TransportKind kind) noexcept
     switch (kind) {
     case TransportKind::Send:
         m_send_transport = std::unique_ptr<mediasoupclient::SendTransport>(
-            m_device.CreateSendTransport(this,
+            m_device->CreateSendTransport(this,
                 transport_options.id,
                 transport_options.ice_parameters,
                 transport_options.ice_candidates,
@@ -210,7 +223,7 @@ void DeviceImpl::ensure_transport(TransportKind kind) noexcept
         break;
     case TransportKind::Recv:
         m_recv_transport = std::unique_ptr<mediasoupclient::RecvTransport>(
-            m_device.CreateRecvTransport(this,
+            m_device->CreateRecvTransport(this,
                 transport_options.id,
                 transport_options.ice_parameters,
                 transport_options.ice_candidates,
@@ -222,9 +235,17 @@ void DeviceImpl::ensure_transport(TransportKind kind) noexcept
     }
 }
 
-void DeviceImpl::create_video_sink(const ConsumerOptions& options, std::shared_ptr<VideoConsumer> user_consumer)
+void DeviceImpl::require_transport(TransportKind kind)
 {
-    ensure_transport(TransportKind::Recv);
+    ensure_transport(kind);
+
+    if (kind == TransportKind::Send ? !m_send_transport : !m_recv_transport)
+        throw MediaSoupClientInvalidStateError("not loaded");
+}
+
+SinkHandle DeviceImpl::create_video_sink(const ConsumerOptions& options, std::shared_ptr<VideoConsumer> user_consumer)
+{
+    require_transport(TransportKind::Recv);
 
     auto consumer = std::unique_ptr<mediasoupclient::Consumer>(
         m_recv_transport->Consume(
@@ -234,12 +255,12 @@ void DeviceImpl::create_video_sink(const ConsumerOptions& options, std::shared_p
             kVideo,
             options.rtp_parameters.is_null() ? nullptr : const_cast<nlohmann::json*>(&options.rtp_parameters)));
 
-    m_sinks.emplace_back(std::make_unique<VideoSinkImpl>(std::move(consumer), std::move(user_consumer)));
+    return m_sinks.insert(std::make_unique<VideoSinkImpl>(std::move(consumer), std::move(user_consumer)));
 }
 
-void DeviceImpl::create_audio_sink(const ConsumerOptions& options, std::shared_ptr<AudioConsumer> user_consumer)
+SinkHandle DeviceImpl::create_audio_sink(const ConsumerOptions& options, std::shared_ptr<AudioConsumer> user_consumer)
 {
-    ensure_transport(TransportKind::Recv);
+    require_transport(TransportKind::Recv);
 
     auto consumer = std::unique_ptr<mediasoupclient::Consumer>(
         m_recv_transport->Consume(
@@ -249,33 +270,21 @@ void DeviceImpl::create_audio_sink(const ConsumerOptions& options, std::shared_p
             kAudio,
             options.rtp_parameters.is_null() ? nullptr : const_cast<nlohmann::json*>(&options.rtp_parameters)));
 
-    m_sinks.emplace_back(std::make_unique<AudioSinkImpl>(std::move(consumer), std::move(user_consumer)));
+    return m_sinks.insert(std::make_unique<AudioSinkImpl>(std::move(consumer), std::move(user_consumer)));
 }
 
-void DeviceImpl::close_sink(const void* consumer) noexcept
+void DeviceImpl::on_sink_closed(std::optional<SinkRegistry::Sink> sink) noexcept
 {
-    for (auto it = m_sinks.begin(); it != m_sinks.end(); it++) {
-        auto& sink = *it;
-        if (!sink->is_user_ptr_equal(consumer))
-            continue;
+    if (!sink)
+        return;
 
-        sink->on_close();
-        m_sinks.erase(it);
-        break;
-    }
+    if (auto* media_sink = std::get_if<std::unique_ptr<SinkImpl>>(&*sink))
+        (*media_sink)->on_close();
 }
 
 void DeviceImpl::OnTransportClose(mediasoupclient::Consumer* consumer)
 {
-    for (auto it = m_sinks.begin(); it != m_sinks.end(); it++) {
-        auto& sink = *it;
-        if (!sink->is_consumer_equal(consumer))
-            continue;
-
-        sink->on_close();
-        m_sinks.erase(it);
-        break;
-    }
+    on_sink_closed(m_sinks.erase_by_consumer(consumer));
 }
 
 void DeviceImpl::close_sender(const void* producer) noexcept
@@ -285,7 +294,7 @@ void DeviceImpl::close_sender(const void* producer) noexcept
 
 std::shared_ptr<VideoSender> DeviceImpl::create_video_source(const ProducerOptions& options)
 {
-    ensure_transport(TransportKind::Send);
+    require_transport(TransportKind::Send);
 
     auto* source = new rtc::RefCountedObject<::msc::VideoSenderImpl>(2, false);
     auto track = m_peer_connection_factory->CreateVideoTrack("video_track_X", source);
@@ -298,7 +307,7 @@ std::shared_ptr<VideoSender> DeviceImpl::create_video_source(const ProducerOptio
 
 std::shared_ptr<AudioSender> DeviceImpl::create_audio_source(const ProducerOptions& options)
 {
-    ensure_transport(TransportKind::Send);
+    require_transport(TransportKind::Send);
 
     auto audio_sender = std::make_shared<AudioSenderImpl>();
     auto audio_source = m_peer_connection_factory->CreateAudioSource(cricket::AudioOptions());
@@ -323,9 +332,9 @@ std::shared_ptr<AudioSender> DeviceImpl::create_audio_source(const ProducerOptio
     return audio_sender;
 }
 
-void DeviceImpl::create_data_sink(const std::string& consumer_id, const std::string& producer_id, uint16_t stream_id, const std::string& label, const std::string& protocol, std::shared_ptr<DataConsumer> user_consumer)
+SinkHandle DeviceImpl::create_data_sink(const std::string& consumer_id, const std::string& producer_id, uint16_t stream_id, const std::string& label, const std::string& protocol, std::shared_ptr<DataConsumer> user_consumer)
 {
-    ensure_transport(TransportKind::Recv);
+    require_transport(TransportKind::Recv);
 
     auto wrapper_consumer = std::make_unique<DataConsumerImpl>(user_consumer);
     auto data_consumer = std::unique_ptr<mediasoupclient::DataConsumer>(
@@ -338,18 +347,7 @@ void DeviceImpl::create_data_sink(const std::string& consumer_id, const std::str
             protocol));
 
     wrapper_consumer->set_consumer(std::move(data_consumer));
-    m_data_sinks.push_back(std::move(wrapper_consumer));
-}
-
-void DeviceImpl::close_data_sink(const std::shared_ptr<DataConsumer>& user_consumer) noexcept
-{
-    for (auto it = m_data_sinks.begin(); it != m_data_sinks.end(); ++it) {
-        auto& sink = *it;
-        if (sink->is_user_ptr_equal(user_consumer.get())) {
-            m_data_sinks.erase(it);
-            break;
-        }
-    }
+    return m_sinks.insert(std::move(wrapper_consumer));
 }
 
 std::shared_ptr<DataSender> DeviceImpl::create_data_source(
@@ -359,7 +357,7 @@ std::shared_ptr<DataSender> DeviceImpl::create_data_source(
     int maxRetransmits,
     int maxPacketLifeTime)
 {
-    ensure_transport(TransportKind::Send);
+    require_transport(TransportKind::Send);
     auto data_producer = std::unique_ptr<mediasoupclient::DataProducer>(
         m_send_transport->ProduceData(
             this,
@@ -395,8 +393,8 @@ struct ReEncodeContext {
 
 std::shared_ptr<void> DeviceImpl::re_encode(MediaKind kind, const ConsumerOptions& consumer_options, const ProducerOptions& producer_options)
 {
-    ensure_transport(TransportKind::Recv);
-    ensure_transport(TransportKind::Send);
+    require_transport(TransportKind::Recv);
+    require_transport(TransportKind::Send);
 
     auto consumer = std::unique_ptr<mediasoupclient::Consumer>(
         m_recv_transport->Consume(
@@ -0,0 +1,82 @@
+#include "./sink_registry.hpp"
+
+namespace msc
+{
+
+SinkHandle SinkRegistry::insert(Sink sink)
+{
+    const void* consumer = consumer_of(sink);
+    const void* user_consumer = user_consumer_of(sink);
+
+    auto handle = m_sinks.insert(std::move(sink));
+    m_by_consumer.insert_or_assign(consumer, handle);
+
+    // Sinks without a user consumer are only reachable by handle and consumer.
+    if (user_consumer)
+        m_by_user_consumer.emplace(user_consumer, handle);
+
+    return handle;
+}
+
+std::optional<SinkRegistry::Sink> SinkRegistry::erase(SinkHandle handle)
+{
+    auto sink = m_sinks.erase(handle);
+    if (!sink)
+        return std::nullopt;
+
+    auto consumer = m_by_consumer.find(consumer_of(*sink));
+    if (consumer != m_by_consumer.end() && consumer->second == handle)
+        m_by_consumer.erase(consumer);
+
+    if (const void* user_consumer = user_consumer_of(*sink)) {
+        auto [begin, end] = m_by_user_consumer.equal_range(user_consumer);
+        for (auto it = begin; it != end; ++it) {
+            if (it->second == handle) {
+                m_by_user_consumer.erase(it);
+                break;
+            }
+        }
+    }
+
+    return sink;
+}
+
+std::optional<SinkRegistry::Sink> SinkRegistry::erase_by_consumer(const void* consumer)
+{
+    auto it = m_by_consumer.find(consumer);
+    if (it == m_by_consumer.end())
+        return std::nullopt;
+
+    return erase(it->second);
+}
+
+std::optional<SinkRegistry::Sink> SinkRegistry::erase_by_user_consumer(const void* user_consumer)
+{
+    if (!user_consumer)
+        return std::nullopt;
+
+    auto it = m_by_user_consumer.find(user_consumer);
+    if (it == m_by_user_consumer.end())
+        return std::nullopt;
+
+    return erase(it->second);
+}
+
+void SinkRegistry::clear()
+{
+    m_by_consumer.clear();
+    m_by_user_consumer.clear();
+    m_sinks.clear();
+}
+
+const void* SinkRegistry::consumer_of(const Sink& sink)
+{
+    return std::visit([](const auto& impl) -> const void* { return impl->consumer(); }, sink);
+}
+
+const void* SinkRegistry::user_consumer_of(const Sink& sink)
+{
+    return std::visit([](const auto& impl) -> const void* { return impl->user_consumer(); }, sink);
+}
+
+}
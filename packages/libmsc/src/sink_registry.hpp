@@ -0,0 +1,57 @@
+#pragma once
+
+#include "./media_sink.hpp"
+
+#include <common/slot_map.hpp>
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+
+namespace msc
+{
+
+/**
+ * The sinks of a Device, found in O(1) by handle, by mediasoupclient consumer and by user consumer.
+ * Closing one is O(1) too, where scanning a vector and erasing from its middle made churn in a large room quadratic.
+ *
+ * Several sinks may share a user consumer, a lookup by user consumer then finds any one of them.
+ * Not thread safe, Device calls are not either.
+ */
+class SinkRegistry
+{
+public:
+    using Sink = std::variant<std::unique_ptr<SinkImpl>, std::unique_ptr<DataConsumerImpl>>;
+
+    size_t size() const { return m_sinks.size(); }
+
+    SinkHandle insert(Sink sink);
+
+    /**
+     * Take the sink out of the registry, the caller destroys it.
+     *
+     * @return std::nullopt if the handle is stale or nothing is registered for the pointer.
+     */
+    std::optional<Sink> erase(SinkHandle handle);
+    std::optional<Sink> erase_by_consumer(const void* consumer);
+    std::optional<Sink> erase_by_user_consumer(const void* user_consumer);
+
+    /**
+     * @return nullptr if the handle is stale.
+     */
+    Sink* find(SinkHandle handle) { return m_sinks.get(handle); }
+
+    void clear();
+
+private:
+    static const void* consumer_of(const Sink& sink);
+    static const void* user_consumer_of(const Sink& sink);
+
+private:
+    cm::SlotMap<Sink> m_sinks {};
+    std::unordered_map<const void*, SinkHandle> m_by_consumer {};
+    std::unordered_multimap<const void*, SinkHandle> m_by_user_consumer {};
+};
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <hv/AsyncHttpClient.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+struct HttpCacheOptions {
+    // How long a response is served from the cache when it does not say otherwise with Cache-Control: max-age.
+    std::chrono::milliseconds default_ttl { std::chrono::seconds(5) };
+    size_t max_entries { 1024 };
+};
+
+/**
+ * GET responses shared between HttpClients.
+ * Identical GETs, same url and headers, sent while one is in flight wait for it instead of going upstream (single-flight),
+ * and successful responses are reused until their TTL runs out.
+ *
+ * Only for requests safe to share: the callers get the same response, each in its own copy.
+ * Create it with std::make_shared.
+ */
+class HttpCache : public std::enable_shared_from_this<HttpCache> {
+public:
+    using SendFunction = std::function<void(const HttpRequestPtr&, HttpResponseCallback)>;
+
+    struct Stats {
+        // Served from a stored response.
+        uint64_t hits { 0 };
+        // Waited for an identical request already in flight.
+        uint64_t coalesced { 0 };
+        // Sent upstream.
+        uint64_t misses { 0 };
+        size_t entries { 0 };
+
+        /**
+         * Fraction of lookups that did not go upstream, in [0, 1].
+         */
+        double hit_rate() const;
+    };
+
+    explicit HttpCache(HttpCacheOptions options = {});
+
+    /**
+     * Answer a GET from the cache or from an identical request in flight, or send it with send and share the result.
+     * The callback gets nullptr if the request failed, failures are not cached.
+     */
+    void get(const HttpRequestPtr& request, const SendFunction& send, HttpResponseCallback callback);
+
+    Stats stats();
+
+private:
+    struct Entry {
+        HttpResponsePtr response {};
+        std::chrono::steady_clock::time_point expires_at {};
+        // Waiting for the response while it is in flight, empty once it arrived.
+        std::vector<HttpResponseCallback> waiters {};
+        bool in_flight { false };
+    };
+
+    void on_response(const std::string& key, const HttpResponsePtr& response);
+
+    // Called with m_mutex held.
+    void evict(std::chrono::steady_clock::time_point now);
+
+private:
+    HttpCacheOptions m_options;
+
+    std::mutex m_mutex {};
+    std::unordered_map<std::string, Entry> m_entries {};
+    Stats m_stats {};
+};
+
+}
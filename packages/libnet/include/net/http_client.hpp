@@ -1,19 +1,37 @@
 #pragma once
 
 #include <common/json.hpp>
+#include <common/task.hpp>
 #include <future>
 #include <hv/AsyncHttpClient.h>
 
+#include "./http_cache.hpp"
+#include "./http_pool.hpp"
+
 namespace net {
 
+/**
+ * Sends requests through an HttpPool, clients sharing a pool share its connections.
+ */
 class HttpClient {
 public:
-    explicit HttpClient(std::shared_ptr<hv::AsyncHttpClient>);
+    explicit HttpClient(std::shared_ptr<HttpPool>);
     ~HttpClient() = default;
 
     [[nodiscard]] ::http_headers& headers() { return m_headers; }
     [[nodiscard]] const ::http_headers& headers() const { return m_headers; }
 
+    /**
+     * Share the responses of co_get_cached() through this cache, usually one for every client of a bot.
+     */
+    void set_cache(std::shared_ptr<HttpCache> cache) { m_cache = std::move(cache); }
+
+    /**
+     * Deadline, retries and hedging of every request sent without a policy of its own.
+     */
+    void set_policy(const RequestPolicy& policy) { m_policy = policy; }
+    [[nodiscard]] const RequestPolicy& policy() const { return m_policy; }
+
     std::future<std::shared_ptr<HttpResponse>> get(const std::string& url);
     std::future<std::shared_ptr<HttpResponse>> post(const std::string& url, const nlohmann::json& body);
 
@@ -24,11 +42,32 @@ public:
 
     inline void requestAsync(const std::shared_ptr<HttpRequest>& request, std::function<void(const std::shared_ptr<HttpResponse>&)> cb)
     {
-        m_client->send(request, std::move(cb));
+        m_pool->send(request, std::move(cb), m_policy);
     }
 
+    /**
+     * Awaitable versions of get(), post() and request(), the response is nullptr if the request failed.
+     */
+    cm::Async<std::shared_ptr<HttpResponse>> co_get(const std::string& url);
+    cm::Async<std::shared_ptr<HttpResponse>> co_post(const std::string& url, const nlohmann::json& body);
+    cm::Async<std::shared_ptr<HttpResponse>> co_request(std::shared_ptr<HttpRequest> request);
+    cm::Async<std::shared_ptr<HttpResponse>> co_request(std::shared_ptr<HttpRequest> request, const RequestPolicy& policy);
+
+    /**
+     * co_get() answered through the cache when one is set, for GETs whose response can be shared with every other caller.
+     */
+    cm::Async<std::shared_ptr<HttpResponse>> co_get_cached(const std::string& url);
+    cm::Async<std::shared_ptr<HttpResponse>> co_get_cached(const std::string& url, const RequestPolicy& policy);
+
 private:
-    std::shared_ptr<hv::AsyncHttpClient> m_client;
+    std::shared_ptr<HttpRequest> make_get(const std::string& url) const;
+    std::shared_ptr<HttpRequest> make_post(const std::string& url, const nlohmann::json& body) const;
+
+    cm::Async<std::shared_ptr<HttpResponse>> co_send(std::shared_ptr<HttpRequest> request, const RequestPolicy& policy, bool cached);
+
+    std::shared_ptr<HttpPool> m_pool;
+    std::shared_ptr<HttpCache> m_cache {};
+    RequestPolicy m_policy {};
     ::http_headers m_headers { DefaultHeaders };
 };
 
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <common/histogram.hpp>
+#include <hv/AsyncHttpClient.h>
+#include <hv/EventLoopThread.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace net {
+
+/**
+ * Resolved host addresses, shared by every HttpPool in the process.
+ */
+class DnsCache {
+public:
+    static DnsCache& instance();
+
+    /**
+     * @return The host's address as text, from the cache if it was resolved less than ttl ago. std::nullopt if it does not resolve.
+     */
+    std::optional<std::string> resolve(const std::string& host, std::chrono::milliseconds ttl);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        std::string address;
+        std::chrono::steady_clock::time_point resolved_at;
+    };
+
+    mutable std::mutex m_mutex {};
+    std::unordered_map<std::string, Entry> m_entries {};
+    uint64_t m_hits { 0 };
+    uint64_t m_misses { 0 };
+};
+
+struct HttpPoolOptions {
+    // Requests in flight to one host at once. Each holds one connection, so this also caps the connections open to that host.
+    size_t max_connections_per_host { 16 };
+    // A host's connections are closed once nothing was sent to it for this long.
+    std::chrono::milliseconds idle_timeout { std::chrono::seconds(60) };
+    // How long a resolved address is reused.
+    std::chrono::milliseconds dns_ttl { std::chrono::minutes(5) };
+};
+
+/**
+ * How one call to HttpPool::send() deals with slow and failed attempts.
+ * Retries and hedges only happen for idempotent requests: GET, HEAD, PUT and DELETE, or any request marked idempotent.
+ */
+struct RequestPolicy {
+    // For the whole call, retries and hedges included. The callback gets nullptr once it passed.
+    std::chrono::milliseconds deadline { std::chrono::seconds(10) };
+
+    // Attempts after the first one, when it failed or the server answered 5xx.
+    int max_retries { 0 };
+    // Before retry n, wait a random time up to min(backoff_max, backoff_base * 2^n).
+    std::chrono::milliseconds backoff_base { 100 };
+    std::chrono::milliseconds backoff_max { std::chrono::seconds(2) };
+
+    // Send a second copy once the first has taken longer than this percentile of the endpoint's latency, first answer wins.
+    bool hedge { false };
+    double hedge_percentile { 0.95 };
+
+    bool idempotent { false };
+};
+
+/**
+ * Keep-alive HTTP connections, shared by every HttpClient built on the pool.
+ * Each host gets its own network thread and hv::AsyncHttpClient, which keeps finished connections open for the next request to that host.
+ * Requests over the per-host limit wait their turn instead of opening another connection.
+ *
+ * Plain http requests connect to the address from DnsCache. https requests keep the host name, which the TLS handshake needs,
+ * and only resolve it when a new connection is opened.
+ *
+ * Deadlines, backoff and hedging timers, and the sweep that closes idle hosts, run on one more thread owned by the pool.
+ * Attempt latency is recorded per endpoint, host and path without the query, and drives hedging.
+ *
+ * The pool's callbacks never hold a reference to it, so it is destroyed by whoever drops the last one.
+ * The destructor stops and joins every thread of the pool: do not destroy it from one of its own callbacks.
+ * Calls still in flight by then never get their callback.
+ */
+class HttpPool {
+public:
+    struct Stats {
+        // Attempts sent, retries and hedges included.
+        uint64_t requests { 0 };
+        // Requests that waited for a connection to free up.
+        uint64_t waited { 0 };
+        uint64_t hosts_opened { 0 };
+        uint64_t hosts_closed { 0 };
+        size_t hosts { 0 };
+        // Most requests each open host had in flight at once, the connections it may be keeping open.
+        size_t connections { 0 };
+        size_t in_flight { 0 };
+        size_t waiting { 0 };
+        uint64_t retries { 0 };
+        uint64_t hedges { 0 };
+        // Hedges that answered before the attempt they duplicated.
+        uint64_t hedge_wins { 0 };
+        uint64_t deadline_exceeded { 0 };
+
+        Stats& operator+=(const Stats& other);
+    };
+
+    explicit HttpPool(HttpPoolOptions options = {});
+    ~HttpPool();
+
+    HttpPool(const HttpPool&) = delete;
+    HttpPool& operator=(const HttpPool&) = delete;
+
+    /**
+     * Send a request on a pooled connection, following policy. The callback runs once, on a network thread,
+     * with nullptr if every attempt failed or the deadline passed.
+     */
+    void send(const HttpRequestPtr& request, HttpResponseCallback callback, const RequestPolicy& policy = {});
+
+    Stats stats();
+
+    /**
+     * Attempt latency in milliseconds, of the attempts that got a response, by endpoint.
+     */
+    std::vector<std::pair<std::string, cm::Histogram::Snapshot>> endpoint_latencies();
+
+    const HttpPoolOptions& options() const { return m_options; }
+
+private:
+    struct Pending {
+        HttpRequestPtr request;
+        HttpResponseCallback callback;
+    };
+
+    struct Host {
+        // Declared first to be destroyed last: the thread is joined before the client its callbacks use goes away.
+        std::unique_ptr<hv::AsyncHttpClient> client {};
+        std::unique_ptr<hv::EventLoopThread> thread {};
+        size_t in_flight { 0 };
+        size_t peak_in_flight { 0 };
+        std::deque<Pending> waiting {};
+        std::chrono::steady_clock::time_point last_used {};
+    };
+
+    struct Call;
+
+    void start_attempt(const std::shared_ptr<Call>& call, bool hedge);
+    void on_attempt(const std::shared_ptr<Call>& call, const HttpResponsePtr& response, std::chrono::steady_clock::time_point started, bool hedge);
+    void start_hedge(const std::shared_ptr<Call>& call);
+
+    /**
+     * Give the call its result, unless it already has one.
+     *
+     * @return false if it already had one.
+     */
+    bool complete(const std::shared_ptr<Call>& call, const HttpResponsePtr& response);
+
+    // Send one attempt, waiting for a connection if the host is at its limit.
+    void send_attempt(const HttpRequestPtr& request, HttpResponseCallback callback);
+    void dispatch(const std::string& key, hv::AsyncHttpClient* client, Pending pending);
+
+    /**
+     * Hand the finished request's connection to the next waiting request, or give it back to the host.
+     */
+    void on_complete(const std::string& key);
+
+    /**
+     * Close the hosts nothing was sent to for idle_timeout. Runs periodically on the timer thread.
+     */
+    void close_idle_hosts();
+
+private:
+    HttpPoolOptions m_options;
+    std::unique_ptr<hv::EventLoopThread> m_timers;
+
+    // Set by the destructor, under m_mutex. Callbacks on the pool's threads do nothing once it is, and no host is opened after it.
+    std::atomic_bool m_stopping { false };
+
+    std::mutex m_mutex {};
+    std::unordered_map<std::string, std::unique_ptr<Host>> m_hosts {};
+    Stats m_stats {};
+    std::unordered_map<std::string, std::unique_ptr<cm::Histogram>> m_latencies {};
+};
+
+}
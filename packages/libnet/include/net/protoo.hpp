@@ -1,12 +1,22 @@
 #pragma once
 
 #include <common/json.hpp>
+#include <common/mpsc_queue.hpp>
+#include <common/task.hpp>
+#include <common/timer_wheel.hpp>
 #include <hv/WebSocketClient.h>
 
+#include "./protoo_parser.hpp"
+#include "./protoo_writer.hpp"
+
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <future>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <variant>
 #include <vector>
 
 namespace net {
@@ -19,11 +29,14 @@ struct ProtooResponse {
     nlohmann::json error_reason;
 };
 
+/**
+ * An incoming request, data is parsed when the handler first looks at it.
+ */
 struct ProtooRequest {
     int64_t id;
 
     std::string method;
-    nlohmann::json data;
+    LazyJson data;
 
     ProtooResponse ok(nlohmann::json data)
     {
@@ -46,43 +59,149 @@ struct ProtooRequest {
     }
 };
 
+/**
+ * An incoming notification, data is parsed when the handler first looks at it.
+ */
 struct ProtooNotify {
     std::string method;
-    nlohmann::json data;
+    LazyJson data;
+};
+
+/**
+ * How outgoing frames are batched into socket writes.
+ */
+struct WriteCoalescing {
+    // Flush on the next event loop iteration once this many bytes are queued, without waiting out latency_budget. Also the largest write.
+    size_t max_batch_bytes { 64 * 1024 };
+    // How long a frame may wait for others to share its write, 0 flushes on the next event loop iteration.
+    std::chrono::milliseconds latency_budget { 0 };
 };
 
 class ProtooClient : private hv::WebSocketClient {
 public:
+    /**
+     * Called exactly once per request, from the event loop thread, with either the response or the reason it failed (timeout, connection closed).
+     */
+    using ResponseCallback = cm::Async<ProtooResponse>::Callback;
+
+    static constexpr std::chrono::milliseconds kDefaultTimeout { 10000 };
+
     explicit ProtooClient(std::shared_ptr<hv::EventLoop> loop);
-    ~ProtooClient() = default;
+
+    /**
+     * Waits for the event loop to finish any callback of this client that is running, unless called on the loop thread.
+     * Callbacks still queued find the client gone and do nothing.
+     */
+    ~ProtooClient();
 
     int connect(const std::string& url);
-    using hv::WebSocketClient::close;
+
+    /**
+     * Close the connection and fail every request still waiting for a response.
+     */
+    void close();
 
     void notify(std::string method, nlohmann::json data);
-    std::future<ProtooResponse> request(std::string method, nlohmann::json data);
+
+    /**
+     * @param timeout How long to wait for the response before failing the request. Checked every 100ms, so it may fire up to that much late.
+     */
+    std::future<ProtooResponse> request(std::string method, nlohmann::json data, std::chrono::milliseconds timeout = kDefaultTimeout);
+    void requestAsync(std::string method, nlohmann::json data, ResponseCallback callback, std::chrono::milliseconds timeout = kDefaultTimeout);
+    cm::Async<ProtooResponse> co_request(std::string method, nlohmann::json data, std::chrono::milliseconds timeout = kDefaultTimeout);
     void response(ProtooResponse response);
 
+    /**
+     * Not thread safe, set it before sending anything.
+     */
+    void set_write_coalescing(WriteCoalescing options);
+
+    /**
+     * Frames sent and socket writes made for them so far.
+     */
+    struct WriteStats {
+        uint64_t frames;
+        uint64_t writes;
+    };
+
+    WriteStats write_stats();
+
     std::function<void(ProtooNotify)> on_notify = {};
     std::function<void(ProtooRequest)> on_request = {};
     std::function<void()> on_close = {};
 
 private:
+    struct PendingRequest {
+        // Bumped every time the slot is freed, so an id handed out for an earlier use of the slot no longer matches.
+        uint32_t generation { 0 };
+        bool active { false };
+        std::string method {};
+        ResponseCallback callback {};
+    };
+
+    // Timeouts are swept in ticks of this length, by one loop timer per connection, only running while requests are pending.
+    static constexpr int kTickMs = 100;
+
+    // Request ids are the slot index in the low bits and its generation above, kept under 2^53 to survive a JSON double.
+    static constexpr uint64_t kSlotBits = 24;
+    static constexpr uint64_t kGenerationMask = (uint64_t(1) << 28) - 1;
+
     void on_ws_open();
     void on_ws_message(const std::string& msg);
     void on_ws_close() const;
 
-    struct PendingRequest {
-        std::shared_ptr<std::promise<ProtooResponse>> promise;
-        hv::TimerID timeout;
-    };
+    void complete(uint64_t id, std::exception_ptr error, ProtooResponse response);
+
+    /**
+     * Fail every request whose deadline passed. Runs on the event loop thread.
+     */
+    void sweep_timeouts();
+
+    /**
+     * Mask a text frame on the calling thread and queue it for the event loop to write. Any thread, lock free.
+     */
+    void enqueue_frame(std::string_view payload);
+    void schedule_drain();
+    // Drain on the next event loop iteration, whatever the latency budget.
+    void post_drain();
+
+    /**
+     * Write every queued frame, in batches. Event loop thread only, frames stay queued until the connection is open.
+     */
+    void drain_outbox();
+    void write_batch();
+
+    // Called with m_mutex held.
+    uint64_t add_pending(std::string method, ResponseCallback callback, std::chrono::milliseconds timeout);
+    bool take_pending(uint64_t id, PendingRequest& request);
+    uint64_t id_of(size_t slot) const;
+
+    static uint64_t now_tick();
 
 private:
-    std::mutex m_mutex {};
-    std::atomic_uint64_t m_request_id_gen { 1 };
-    std::unordered_map<uint64_t, PendingRequest> m_awaiting_response {};
+    // Event loop callbacks hold it weakly, and do nothing once the destructor expired it.
+    std::shared_ptr<std::monostate> m_alive { std::make_shared<std::monostate>() };
 
-    std::vector<std::function<void()>> m_buffered_request {};
+    std::mutex m_mutex {};
+    std::vector<PendingRequest> m_pending {};
+    std::vector<uint32_t> m_free_slots {};
+    cm::TimerWheel<std::monostate> m_timeouts;
+    hv::TimerID m_sweep_timer { INVALID_TIMER_ID };
+
+    // A frame ready to write, dropped if close() was called since it was queued.
+    struct OutboundFrame;
+
+    cm::IntrusiveMpscQueue m_outbox {};
+    // Bytes of the frames in m_outbox, for the max_batch_bytes flush.
+    std::atomic_size_t m_queued_bytes { 0 };
+    std::atomic_bool m_drain_scheduled { false };
+    std::atomic_uint64_t m_epoch { 0 };
+    WriteCoalescing m_coalescing {};
+
+    // Event loop thread only.
+    std::string m_batch {};
+    std::atomic_uint64_t m_frames_written { 0 };
+    std::atomic_uint64_t m_writes { 0 };
 };
 
 }
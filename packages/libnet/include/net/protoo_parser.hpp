@@ -0,0 +1,118 @@
+#pragma once
+
+#include <common/json_arena.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace net {
+
+/**
+ * A JSON value kept as text until someone asks for it.
+ * Owns the frame it was sliced from, so it can be moved across threads but not copied.
+ */
+class LazyJson {
+public:
+    LazyJson() = default;
+
+    /**
+     * @param frame The whole message.
+     * @param offset Where the value starts in frame.
+     * @param size The length of the value's text.
+     */
+    LazyJson(std::string frame, size_t offset, size_t size)
+        : m_frame(std::move(frame))
+        , m_offset(offset)
+        , m_size(size)
+    {
+    }
+
+    LazyJson(LazyJson&&) noexcept = default;
+    LazyJson& operator=(LazyJson&&) noexcept = default;
+    LazyJson(const LazyJson&) = delete;
+    LazyJson& operator=(const LazyJson&) = delete;
+
+    [[nodiscard]] std::string_view raw() const noexcept { return std::string_view(m_frame).substr(m_offset, m_size); }
+
+    /**
+     * Parse the value on first use.
+     *
+     * @throw nlohmann::json::parse_error
+     */
+    const nlohmann::json& json()
+    {
+        if (!m_parsed) {
+            auto value = raw();
+            m_parsed = nlohmann::json::parse(value.begin(), value.end());
+        }
+
+        return *m_parsed;
+    }
+
+    /**
+     * Parse the value, or move out the already parsed one.
+     */
+    nlohmann::json take()
+    {
+        json();
+        return std::move(*m_parsed);
+    }
+
+    /**
+     * Parse the value into another basic_json type, without caching it.
+     * With cm::ArenaJson inside a cm::JsonArenaScope, the whole DOM lands in the arena.
+     *
+     * @throw nlohmann::json::parse_error
+     */
+    template<typename Json>
+    Json parse_as() const
+    {
+        auto value = raw();
+        return Json::parse(value.begin(), value.end());
+    }
+
+    const nlohmann::json& at(const std::string& key) { return json().at(key); }
+
+    template<typename T>
+    T get() { return json().template get<T>(); }
+
+private:
+    std::string m_frame {};
+    size_t m_offset { 0 };
+    size_t m_size { 0 };
+    std::optional<nlohmann::json> m_parsed {};
+};
+
+/**
+ * The top level fields of a protoo message, found without building a DOM.
+ * Values are slices of the scanned text, only valid as long as it is.
+ */
+struct ProtooEnvelope {
+    enum class Kind {
+        Request,
+        Response,
+        Notification,
+    };
+
+    Kind kind;
+    bool ok { false };
+    std::optional<int64_t> id {};
+    std::string method {};
+
+    // Raw text of "data" and "errorReason", empty if absent.
+    std::string_view data {};
+    std::string_view error_reason {};
+};
+
+/**
+ * Scan the top level object of a protoo message, skipping over nested values without looking into them.
+ * Nested values are not validated, that happens when they are parsed.
+ *
+ * @return The envelope, std::nullopt if the message is an object but neither a request, response nor notification.
+ * @throw std::runtime_error If the message is not a JSON object.
+ */
+std::optional<ProtooEnvelope> scan_protoo_envelope(std::string_view message);
+
+}
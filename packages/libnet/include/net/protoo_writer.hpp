@@ -0,0 +1,55 @@
+#pragma once
+
+#include <common/json.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace net {
+
+/**
+ * Serializes outgoing protoo messages straight into one reusable buffer, without building an envelope DOM.
+ * Envelope prefixes are built once per method, so a message only costs its id and payload, and no allocation once the buffer has grown.
+ *
+ * Not thread safe. Every call overwrites the frame returned by the previous one, send it before writing the next.
+ */
+class ProtooWriter {
+public:
+    ProtooWriter();
+    ~ProtooWriter();
+
+    ProtooWriter(const ProtooWriter&) = delete;
+    ProtooWriter& operator=(const ProtooWriter&) = delete;
+
+    const std::string& request(int64_t id, std::string_view method, const nlohmann::json& data);
+    const std::string& notification(std::string_view method, const nlohmann::json& data);
+    const std::string& response(int64_t id, const nlohmann::json& data);
+    const std::string& error_response(int64_t id, const nlohmann::json& error_reason);
+
+private:
+    struct StringHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view value) const noexcept { return std::hash<std::string_view> {}(value); }
+    };
+
+    using PrefixCache = std::unordered_map<std::string, std::string, StringHash, std::equal_to<>>;
+
+    void begin();
+    void append_prefix(PrefixCache& cache, std::string_view kind, std::string_view method, std::string_view next_key);
+    void append_id(int64_t id);
+    void append_value(const nlohmann::json& value);
+
+private:
+    std::string m_buffer {};
+    std::unique_ptr<nlohmann::detail::serializer<nlohmann::json>> m_serializer;
+
+    PrefixCache m_request_prefixes {};
+    PrefixCache m_notification_prefixes {};
+};
+
+}
@@ -0,0 +1,163 @@
+#include "net/http_cache.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace net {
+
+namespace {
+
+std::string cache_key(const HttpRequest& request)
+{
+    std::string key = request.url;
+    for (const auto& [name, value] : request.headers) {
+        key += '\n';
+        key += name;
+        key += ':';
+        key += value;
+    }
+
+    return key;
+}
+
+/**
+ * How long a response can be reused, zero if it must not be.
+ */
+std::chrono::milliseconds response_ttl(const HttpResponsePtr& response, std::chrono::milliseconds default_ttl)
+{
+    if (!response || response->status_code != 200)
+        return std::chrono::milliseconds(0);
+
+    std::string cache_control = response->GetHeader("Cache-Control");
+    std::transform(cache_control.begin(), cache_control.end(), cache_control.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+    if (cache_control.find("no-store") != std::string::npos || cache_control.find("no-cache") != std::string::npos)
+        return std::chrono::milliseconds(0);
+
+    size_t max_age = cache_control.find("max-age=");
+    if (max_age != std::string::npos) {
+        int64_t seconds = 0;
+        for (size_t i = max_age + 8; i < cache_control.size() && std::isdigit(static_cast<unsigned char>(cache_control[i])); i++) {
+            seconds = seconds * 10 + (cache_control[i] - '0');
+        }
+
+        return std::chrono::seconds(seconds);
+    }
+
+    return default_ttl;
+}
+
+}
+
+double HttpCache::Stats::hit_rate() const
+{
+    uint64_t lookups = hits + coalesced + misses;
+    return lookups == 0 ? 0.0 : double(hits + coalesced) / double(lookups);
+}
+
+HttpCache::HttpCache(HttpCacheOptions options)
+    : m_options(options)
+{
+}
+
+void HttpCache::get(const HttpRequestPtr& request, const SendFunction& send, HttpResponseCallback callback)
+{
+    std::string key = cache_key(*request);
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::unique_lock lk(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            auto& entry = it->second;
+            if (entry.in_flight) {
+                entry.waiters.push_back(std::move(callback));
+                m_stats.coalesced++;
+                return;
+            }
+
+            if (now < entry.expires_at) {
+                auto response = std::make_shared<HttpResponse>(*entry.response);
+                m_stats.hits++;
+                lk.unlock();
+
+                if (callback)
+                    callback(response);
+
+                return;
+            }
+        } else if (m_entries.size() >= m_options.max_entries) {
+            evict(now);
+        }
+
+        auto& entry = m_entries[key];
+        entry.response = nullptr;
+        entry.in_flight = true;
+        entry.waiters.push_back(std::move(callback));
+        m_stats.misses++;
+    }
+
+    send(request, [weak = weak_from_this(), key = std::move(key)](const HttpResponsePtr& response) {
+        if (auto cache = weak.lock())
+            cache->on_response(key, response);
+    });
+}
+
+void HttpCache::on_response(const std::string& key, const HttpResponsePtr& response)
+{
+    std::vector<HttpResponseCallback> waiters;
+    {
+        std::scoped_lock lk(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+            return;
+
+        auto& entry = it->second;
+        waiters = std::move(entry.waiters);
+        entry.waiters.clear();
+        entry.in_flight = false;
+
+        auto ttl = response_ttl(response, m_options.default_ttl);
+        if (ttl.count() > 0) {
+            entry.response = response;
+            entry.expires_at = std::chrono::steady_clock::now() + ttl;
+        } else {
+            m_entries.erase(it);
+        }
+    }
+
+    // Copies, a response is not safe to read from several threads: GetJson() caches what it parsed.
+    for (auto& waiter : waiters) {
+        if (waiter)
+            waiter(response ? std::make_shared<HttpResponse>(*response) : nullptr);
+    }
+}
+
+void HttpCache::evict(std::chrono::steady_clock::time_point now)
+{
+    auto oldest = m_entries.end();
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->second.in_flight) {
+            it++;
+        } else if (it->second.expires_at <= now) {
+            it = m_entries.erase(it);
+        } else {
+            if (oldest == m_entries.end() || it->second.expires_at < oldest->second.expires_at)
+                oldest = it;
+
+            it++;
+        }
+    }
+
+    if (m_entries.size() >= m_options.max_entries && oldest != m_entries.end())
+        m_entries.erase(oldest);
+}
+
+HttpCache::Stats HttpCache::stats()
+{
+    std::scoped_lock lk(m_mutex);
+    Stats stats = m_stats;
+    stats.entries = m_entries.size();
+    return stats;
+}
+
+}
@@ -2,56 +2,100 @@
 
 namespace net {
 
-HttpClient::HttpClient(std::shared_ptr<hv::AsyncHttpClient> client)
-    : m_client(std::move(client))
+HttpClient::HttpClient(std::shared_ptr<HttpPool> pool)
+    : m_pool(std::move(pool))
 {
 }
 
 std::future<std::shared_ptr<HttpResponse>> HttpClient::get(const std::string& url)
 {
-    auto req = std::make_shared<HttpRequest>();
-    req->method = HTTP_GET;
-    req->url = url;
-    req->headers = m_headers;
-
-    return request(req);
+    return request(make_get(url));
 }
 
 std::future<std::shared_ptr<HttpResponse>> HttpClient::post(const std::string& url, const nlohmann::json& body)
 {
-    auto req = std::make_shared<HttpRequest>();
-    req->method = HTTP_POST;
-    req->url = url;
-    req->headers = m_headers;
-    req->headers["Content-Type"] = "application/json";
-    req->Json(body);
-
-    return request(req);
+    return request(make_post(url, body));
 }
 
 std::future<std::shared_ptr<HttpResponse>> HttpClient::request(const std::shared_ptr<HttpRequest>& request)
 {
-    request->timeout = 10;
-
     auto future_resp = std::make_shared<std::promise<std::shared_ptr<HttpResponse>>>();
-    m_client->send(request, [future_resp](const std::shared_ptr<HttpResponse>& resp) {
+    m_pool->send(request, [future_resp](const std::shared_ptr<HttpResponse>& resp) {
         future_resp->set_value(resp);
-    });
+    }, m_policy);
 
     return future_resp->get_future();
 }
 
 void HttpClient::getAsync(const std::string& url, std::function<void(const std::shared_ptr<HttpResponse>&)> cb)
+{
+    requestAsync(make_get(url), std::move(cb));
+}
+
+void HttpClient::postAsync(const std::string& url, const nlohmann::json& body, std::function<void(const std::shared_ptr<HttpResponse>&)> cb)
+{
+    requestAsync(make_post(url, body), std::move(cb));
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_get(const std::string& url)
+{
+    return co_request(make_get(url));
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_post(const std::string& url, const nlohmann::json& body)
+{
+    return co_request(make_post(url, body));
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_request(std::shared_ptr<HttpRequest> request)
+{
+    return co_send(std::move(request), m_policy, false);
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_request(std::shared_ptr<HttpRequest> request, const RequestPolicy& policy)
+{
+    return co_send(std::move(request), policy, false);
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_get_cached(const std::string& url)
+{
+    return co_send(make_get(url), m_policy, m_cache != nullptr);
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_get_cached(const std::string& url, const RequestPolicy& policy)
+{
+    return co_send(make_get(url), policy, m_cache != nullptr);
+}
+
+cm::Async<std::shared_ptr<HttpResponse>> HttpClient::co_send(std::shared_ptr<HttpRequest> request, const RequestPolicy& policy, bool cached)
+{
+    using Callback = cm::Async<std::shared_ptr<HttpResponse>>::Callback;
+    return cm::Async<std::shared_ptr<HttpResponse>>([this, request = std::move(request), policy, cached](Callback callback) {
+        // hv::AsyncHttpClient wants a copyable callback
+        auto shared_callback = std::make_shared<Callback>(std::move(callback));
+        auto on_response = [shared_callback](const std::shared_ptr<HttpResponse>& resp) {
+            (*shared_callback)(nullptr, resp);
+        };
+
+        if (cached) {
+            m_cache->get(request, [pool = m_pool, policy](const HttpRequestPtr& req, HttpResponseCallback cb) { pool->send(req, std::move(cb), policy); }, std::move(on_response));
+        } else {
+            m_pool->send(request, std::move(on_response), policy);
+        }
+    });
+}
+
+std::shared_ptr<HttpRequest> HttpClient::make_get(const std::string& url) const
 {
     auto req = std::make_shared<HttpRequest>();
     req->method = HTTP_GET;
     req->url = url;
     req->headers = m_headers;
 
-    requestAsync(req, std::move(cb));
+    return req;
 }
 
-void HttpClient::postAsync(const std::string& url, const nlohmann::json& body, std::function<void(const std::shared_ptr<HttpResponse>&)> cb)
+std::shared_ptr<HttpRequest> HttpClient::make_post(const std::string& url, const nlohmann::json& body) const
 {
     auto req = std::make_shared<HttpRequest>();
     req->method = HTTP_POST;
@@ -60,7 +104,7 @@ void HttpClient::postAsync(const std::string& url, const nlohmann::json& body, s
     req->headers["Content-Type"] = "application/json";
     req->Json(body);
 
-    requestAsync(req, std::move(cb));
+    return req;
 }
 
 }
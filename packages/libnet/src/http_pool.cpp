@@ -0,0 +1,569 @@
+#include "net/http_pool.hpp"
+
+#include <hv/hsocket.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <random>
+#include <string_view>
+
+namespace net {
+
+namespace {
+
+struct Origin {
+    std::string scheme;
+    std::string host;
+    int port;
+    // Where the host starts and ends in the url.
+    size_t host_begin;
+    size_t host_end;
+};
+
+/**
+ * Split scheme, host and port out of an absolute url.
+ */
+std::optional<Origin> parse_origin(std::string_view url)
+{
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string_view::npos)
+        return std::nullopt;
+
+    Origin origin {};
+    origin.scheme = std::string(url.substr(0, scheme_end));
+    std::transform(origin.scheme.begin(), origin.scheme.end(), origin.scheme.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+    size_t authority_begin = scheme_end + 3;
+    size_t authority_end = url.find_first_of("/?#", authority_begin);
+    if (authority_end == std::string_view::npos)
+        authority_end = url.size();
+
+    size_t userinfo_end = url.rfind('@', authority_end);
+    origin.host_begin = userinfo_end != std::string_view::npos && userinfo_end >= authority_begin ? userinfo_end + 1 : authority_begin;
+
+    size_t port_begin = std::string_view::npos;
+    if (origin.host_begin < authority_end && url[origin.host_begin] == '[') {
+        size_t bracket = url.find(']', origin.host_begin);
+        if (bracket == std::string_view::npos || bracket >= authority_end)
+            return std::nullopt;
+
+        origin.host_end = bracket + 1;
+        if (origin.host_end < authority_end && url[origin.host_end] == ':')
+            port_begin = origin.host_end + 1;
+    } else {
+        size_t colon = url.find(':', origin.host_begin);
+        origin.host_end = colon != std::string_view::npos && colon < authority_end ? colon : authority_end;
+        if (origin.host_end < authority_end)
+            port_begin = origin.host_end + 1;
+    }
+
+    if (origin.host_begin == origin.host_end)
+        return std::nullopt;
+
+    origin.host = std::string(url.substr(origin.host_begin, origin.host_end - origin.host_begin));
+    std::transform(origin.host.begin(), origin.host.end(), origin.host.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+    origin.port = origin.scheme == "https" ? 443 : 80;
+    if (port_begin != std::string_view::npos && port_begin < authority_end) {
+        int port = 0;
+        for (char c : url.substr(port_begin, authority_end - port_begin)) {
+            if (!std::isdigit(static_cast<unsigned char>(c)))
+                return std::nullopt;
+
+            port = port * 10 + (c - '0');
+        }
+
+        origin.port = port;
+    }
+
+    return origin;
+}
+
+std::string origin_key(const Origin& origin)
+{
+    return origin.scheme + "://" + origin.host + ":" + std::to_string(origin.port);
+}
+
+/**
+ * Host and path, the query left out so requests that only differ by parameters share latency stats.
+ */
+std::string endpoint_key(std::string_view url, const Origin& origin)
+{
+    size_t path_end = url.find_first_of("?#", origin.host_end);
+    size_t path_begin = url.find('/', origin.host_end);
+    if (path_begin == std::string_view::npos || path_begin > path_end)
+        return origin.host + "/";
+
+    return origin.host + std::string(url.substr(path_begin, path_end == std::string_view::npos ? std::string_view::npos : path_end - path_begin));
+}
+
+bool is_idempotent(http_method method)
+{
+    return method == HTTP_GET || method == HTTP_HEAD || method == HTTP_PUT || method == HTTP_DELETE;
+}
+
+/**
+ * Full jitter: spreads retries of calls that failed together instead of sending them back in lockstep.
+ */
+std::chrono::milliseconds backoff_delay(const RequestPolicy& policy, int retry)
+{
+    thread_local std::minstd_rand generator(std::random_device {}());
+
+    auto ceiling = std::min<int64_t>(policy.backoff_max.count(), policy.backoff_base.count() << std::min(retry, 30));
+    std::uniform_int_distribution<int64_t> distribution(0, std::max<int64_t>(ceiling, 0));
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+// Hedging waits until the endpoint has this many samples, a percentile of fewer is noise.
+constexpr uint64_t kMinHedgeSamples = 20;
+
+// Bounds of the idle sweep period, half the idle timeout.
+constexpr std::chrono::milliseconds kMinIdleSweep { 10 };
+constexpr std::chrono::milliseconds kMaxIdleSweep { 1000 };
+
+/**
+ * Point a plain http request at the cached address of its host.
+ */
+void resolve(HttpRequest& request, const Origin& origin, std::chrono::milliseconds ttl)
+{
+    if (origin.scheme != "http" || is_ipaddr(origin.host.c_str()))
+        return;
+
+    auto address = DnsCache::instance().resolve(origin.host, ttl);
+    if (!address)
+        return;
+
+    // The server still routes on the name.
+    bool default_port = origin.port == 80;
+    request.headers["Host"] = default_port ? origin.host : origin.host + ":" + std::to_string(origin.port);
+
+    bool ipv6 = address->find(':') != std::string::npos;
+    request.url.replace(origin.host_begin, origin.host_end - origin.host_begin, ipv6 ? "[" + *address + "]" : *address);
+}
+
+}
+
+DnsCache& DnsCache::instance()
+{
+    static DnsCache cache;
+    return cache;
+}
+
+std::optional<std::string> DnsCache::resolve(const std::string& host, std::chrono::milliseconds ttl)
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock lk(m_mutex);
+        auto it = m_entries.find(host);
+        if (it != m_entries.end() && now - it->second.resolved_at < ttl) {
+            m_hits++;
+            return it->second.address;
+        }
+
+        m_misses++;
+    }
+
+    // Blocking, so not under the lock. Concurrent misses on one host may both resolve it, the last one wins.
+    sockaddr_u addr {};
+    if (ResolveAddr(host.c_str(), &addr) != 0)
+        return std::nullopt;
+
+    char ip[64] = {};
+    sockaddr_ip(&addr, ip, sizeof(ip));
+
+    std::string address = ip;
+    std::scoped_lock lk(m_mutex);
+    m_entries[host] = Entry { address, now };
+    return address;
+}
+
+uint64_t DnsCache::hits() const
+{
+    std::scoped_lock lk(m_mutex);
+    return m_hits;
+}
+
+uint64_t DnsCache::misses() const
+{
+    std::scoped_lock lk(m_mutex);
+    return m_misses;
+}
+
+HttpPool::Stats& HttpPool::Stats::operator+=(const Stats& other)
+{
+    requests += other.requests;
+    waited += other.waited;
+    hosts_opened += other.hosts_opened;
+    hosts_closed += other.hosts_closed;
+    hosts += other.hosts;
+    connections += other.connections;
+    in_flight += other.in_flight;
+    waiting += other.waiting;
+    retries += other.retries;
+    hedges += other.hedges;
+    hedge_wins += other.hedge_wins;
+    deadline_exceeded += other.deadline_exceeded;
+    return *this;
+}
+
+struct HttpPool::Call {
+    // Never sent itself, every attempt sends a copy.
+    HttpRequestPtr request;
+    HttpResponseCallback callback;
+    RequestPolicy policy;
+    std::string endpoint;
+    bool retryable;
+    std::chrono::steady_clock::time_point deadline;
+
+    std::mutex mutex {};
+    bool done { false };
+    int outstanding { 0 };
+    int retries { 0 };
+    bool hedged { false };
+    hv::TimerID deadline_timer { INVALID_TIMER_ID };
+};
+
+HttpPool::HttpPool(HttpPoolOptions options)
+    : m_options(options)
+    , m_timers(std::make_unique<hv::EventLoopThread>())
+{
+    m_options.max_connections_per_host = std::max<size_t>(m_options.max_connections_per_host, 1);
+    m_timers->start();
+
+    // A host is closed between idle_timeout and half as long again after its last request.
+    auto sweep_period = std::clamp<std::chrono::milliseconds>(m_options.idle_timeout / 2, kMinIdleSweep, kMaxIdleSweep);
+    m_timers->loop()->setInterval(static_cast<int>(sweep_period.count()), [this](hv::TimerID) {
+        if (!m_stopping)
+            close_idle_hosts();
+    });
+}
+
+HttpPool::~HttpPool()
+{
+    {
+        // Callbacks that have not started yet do nothing from here on, the ones already running are waited for below.
+        std::scoped_lock lk(m_mutex);
+        m_stopping = true;
+    }
+
+    m_timers->stop(true);
+
+    std::unordered_map<std::string, std::unique_ptr<Host>> hosts;
+    {
+        std::scoped_lock lk(m_mutex);
+        hosts.swap(m_hosts);
+    }
+
+    // Joins every host thread, outside the lock their last callbacks may still be waiting for.
+    hosts.clear();
+}
+
+void HttpPool::send(const HttpRequestPtr& request, HttpResponseCallback callback, const RequestPolicy& policy)
+{
+    auto origin = parse_origin(request->url);
+    if (!origin) {
+        if (callback)
+            callback(nullptr);
+
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto call = std::make_shared<Call>();
+    call->request = request;
+    call->callback = std::move(callback);
+    call->policy = policy;
+    call->endpoint = endpoint_key(request->url, *origin);
+    call->retryable = policy.idempotent || is_idempotent(request->method);
+    call->deadline = now + policy.deadline;
+
+    auto timer = m_timers->loop()->setTimeout(static_cast<int>(policy.deadline.count()), [this, call](hv::TimerID) {
+        if (!m_stopping && complete(call, nullptr)) {
+            std::scoped_lock lk(m_mutex);
+            m_stats.deadline_exceeded++;
+        }
+    });
+
+    {
+        std::scoped_lock lk(call->mutex);
+        call->deadline_timer = timer;
+    }
+
+    start_attempt(call, false);
+}
+
+void HttpPool::start_attempt(const std::shared_ptr<Call>& call, bool hedge)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(call->deadline - now);
+    if (remaining.count() <= 0)
+        return;
+
+    {
+        std::scoped_lock lk(call->mutex);
+        if (call->done)
+            return;
+
+        call->outstanding++;
+    }
+
+    auto attempt = std::make_shared<HttpRequest>(*call->request);
+    // libhv counts in whole seconds, the deadline timer cuts it short.
+    attempt->timeout = std::max(1, static_cast<int>(std::ceil(double(remaining.count()) / 1000.0)));
+
+    send_attempt(attempt, [this, call, now, hedge](const HttpResponsePtr& response) {
+        if (!m_stopping)
+            on_attempt(call, response, now, hedge);
+    });
+
+    if (hedge || !call->policy.hedge || !call->retryable)
+        return;
+
+    std::optional<std::chrono::milliseconds> delay;
+    {
+        std::scoped_lock lk(m_mutex);
+        auto it = m_latencies.find(call->endpoint);
+        if (it != m_latencies.end()) {
+            auto snapshot = it->second->snapshot();
+            if (snapshot.count() >= kMinHedgeSamples)
+                delay = std::chrono::milliseconds(snapshot.percentile(call->policy.hedge_percentile));
+        }
+    }
+
+    if (delay && *delay < remaining) {
+        m_timers->loop()->setTimeout(static_cast<int>(std::max<int64_t>(delay->count(), 1)), [this, call](hv::TimerID) {
+            if (!m_stopping)
+                start_hedge(call);
+        });
+    }
+}
+
+void HttpPool::start_hedge(const std::shared_ptr<Call>& call)
+{
+    {
+        std::scoped_lock lk(call->mutex);
+        // Not once the call finished, nor while it waits to retry.
+        if (call->done || call->hedged || call->outstanding == 0)
+            return;
+
+        call->hedged = true;
+    }
+
+    {
+        std::scoped_lock lk(m_mutex);
+        m_stats.hedges++;
+    }
+
+    start_attempt(call, true);
+}
+
+void HttpPool::on_attempt(const std::shared_ptr<Call>& call, const HttpResponsePtr& response, std::chrono::steady_clock::time_point started, bool hedge)
+{
+    if (response) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+
+        std::scoped_lock lk(m_mutex);
+        auto& latency = m_latencies[call->endpoint];
+        if (!latency)
+            latency = std::make_unique<cm::Histogram>();
+
+        latency->record(static_cast<uint64_t>(elapsed.count()));
+    }
+
+    bool succeeded = response && response->status_code < 500;
+    std::optional<std::chrono::milliseconds> retry_delay;
+    {
+        std::scoped_lock lk(call->mutex);
+        call->outstanding--;
+        if (call->done)
+            return;
+
+        // A hedge still in flight may yet succeed.
+        if (!succeeded && call->outstanding > 0)
+            return;
+
+        if (!succeeded && call->retryable && call->retries < call->policy.max_retries) {
+            auto delay = backoff_delay(call->policy, call->retries);
+            if (std::chrono::steady_clock::now() + delay < call->deadline) {
+                call->retries++;
+                retry_delay = delay;
+            }
+        }
+    }
+
+    if (retry_delay) {
+        {
+            std::scoped_lock lk(m_mutex);
+            m_stats.retries++;
+        }
+
+        m_timers->loop()->setTimeout(static_cast<int>(std::max<int64_t>(retry_delay->count(), 1)), [this, call](hv::TimerID) {
+            if (!m_stopping)
+                start_attempt(call, false);
+        });
+        return;
+    }
+
+    if (complete(call, response) && succeeded && hedge) {
+        std::scoped_lock lk(m_mutex);
+        m_stats.hedge_wins++;
+    }
+}
+
+bool HttpPool::complete(const std::shared_ptr<Call>& call, const HttpResponsePtr& response)
+{
+    hv::TimerID timer;
+    {
+        std::scoped_lock lk(call->mutex);
+        if (call->done)
+            return false;
+
+        call->done = true;
+        timer = call->deadline_timer;
+    }
+
+    if (timer != INVALID_TIMER_ID)
+        m_timers->loop()->killTimer(timer);
+
+    if (call->callback)
+        call->callback(response);
+
+    return true;
+}
+
+void HttpPool::send_attempt(const HttpRequestPtr& request, HttpResponseCallback callback)
+{
+    auto origin = parse_origin(request->url);
+    if (!origin) {
+        if (callback)
+            callback(nullptr);
+
+        return;
+    }
+
+    std::string key = origin_key(*origin);
+    resolve(*request, *origin, m_options.dns_ttl);
+
+    auto now = std::chrono::steady_clock::now();
+
+    hv::AsyncHttpClient* client;
+    {
+        std::unique_lock lk(m_mutex);
+        if (m_stopping) {
+            lk.unlock();
+            if (callback)
+                callback(nullptr);
+
+            return;
+        }
+
+        auto& host = m_hosts[key];
+        if (!host) {
+            host = std::make_unique<Host>();
+            host->thread = std::make_unique<hv::EventLoopThread>();
+            host->thread->start();
+            host->client = std::make_unique<hv::AsyncHttpClient>(host->thread->loop());
+            m_stats.hosts_opened++;
+        }
+
+        host->last_used = now;
+        m_stats.requests++;
+
+        if (host->in_flight >= m_options.max_connections_per_host) {
+            host->waiting.push_back(Pending { request, std::move(callback) });
+            m_stats.waited++;
+            return;
+        }
+
+        host->in_flight++;
+        host->peak_in_flight = std::max(host->peak_in_flight, host->in_flight);
+        client = host->client.get();
+    }
+
+    dispatch(key, client, Pending { request, std::move(callback) });
+}
+
+void HttpPool::dispatch(const std::string& key, hv::AsyncHttpClient* client, Pending pending)
+{
+    client->send(pending.request, [this, key, callback = std::move(pending.callback)](const HttpResponsePtr& response) {
+        if (callback)
+            callback(response);
+
+        if (!m_stopping)
+            on_complete(key);
+    });
+}
+
+void HttpPool::on_complete(const std::string& key)
+{
+    std::scoped_lock lk(m_mutex);
+    auto it = m_hosts.find(key);
+    if (it == m_hosts.end())
+        return;
+
+    auto& host = *it->second;
+    host.last_used = std::chrono::steady_clock::now();
+    if (host.waiting.empty()) {
+        host.in_flight--;
+        return;
+    }
+
+    // The connection only goes back to the client's pool after this callback returns,
+    // sending from here would open a new one. Queue the next request behind it instead.
+    auto pending = std::make_shared<Pending>(std::move(host.waiting.front()));
+    host.waiting.pop_front();
+    host.thread->loop()->queueInLoop([this, key, client = host.client.get(), pending]() {
+        if (!m_stopping)
+            dispatch(key, client, std::move(*pending));
+    });
+}
+
+void HttpPool::close_idle_hosts()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    // Destroyed after the lock is released, stopping a host joins its thread.
+    std::vector<std::unique_ptr<Host>> idle;
+    {
+        std::scoped_lock lk(m_mutex);
+        for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+            auto& host = *it->second;
+            if (host.in_flight == 0 && now - host.last_used >= m_options.idle_timeout) {
+                idle.push_back(std::move(it->second));
+                it = m_hosts.erase(it);
+                m_stats.hosts_closed++;
+            } else {
+                it++;
+            }
+        }
+    }
+}
+
+HttpPool::Stats HttpPool::stats()
+{
+    std::scoped_lock lk(m_mutex);
+    Stats stats = m_stats;
+    for (const auto& [key, host] : m_hosts) {
+        stats.hosts++;
+        stats.connections += host->peak_in_flight;
+        stats.in_flight += host->in_flight;
+        stats.waiting += host->waiting.size();
+    }
+
+    return stats;
+}
+
+std::vector<std::pair<std::string, cm::Histogram::Snapshot>> HttpPool::endpoint_latencies()
+{
+    std::scoped_lock lk(m_mutex);
+    std::vector<std::pair<std::string, cm::Histogram::Snapshot>> latencies;
+    latencies.reserve(m_latencies.size());
+    for (const auto& [endpoint, histogram] : m_latencies) {
+        latencies.emplace_back(endpoint, histogram->snapshot());
+    }
+
+    return latencies;
+}
+
+}
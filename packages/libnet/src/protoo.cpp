@@ -1,18 +1,83 @@
 #include "net/protoo.hpp"
 
 #include <common/logger.hpp>
+#include <hv/wsdef.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <random>
 #include <sstream>
 
 namespace net {
 
+/**
+ * The masked frame follows the struct in the same allocation, so queueing a message costs one allocation including its link.
+ */
+struct ProtooClient::OutboundFrame : cm::MpscNode {
+    struct Deleter {
+        void operator()(OutboundFrame* frame) const noexcept
+        {
+            frame->~OutboundFrame();
+            ::operator delete(frame);
+        }
+    };
+
+    using Ptr = std::unique_ptr<OutboundFrame, Deleter>;
+
+    uint64_t epoch { 0 };
+    size_t size { 0 };
+
+    static Ptr create(size_t size, uint64_t epoch)
+    {
+        Ptr frame(new (::operator new(sizeof(OutboundFrame) + size)) OutboundFrame());
+        frame->epoch = epoch;
+        frame->size = size;
+        return frame;
+    }
+
+    char* bytes() noexcept { return reinterpret_cast<char*>(this + 1); }
+};
+
 ProtooClient::ProtooClient(std::shared_ptr<hv::EventLoop> loop)
     : WebSocketClient(std::move(loop))
+    , m_timeouts(now_tick())
 {
     onopen = [this] { on_ws_open(); };
     onclose = [this] { on_ws_close(); };
     onmessage = [this](auto&& PH1) { on_ws_message(std::forward<decltype(PH1)>(PH1)); };
 }
 
+ProtooClient::~ProtooClient()
+{
+    // Loop callbacks check m_alive on the loop thread, so expiring it there means none is running and none will touch this again.
+    auto teardown = [this]() {
+        std::scoped_lock lk(m_mutex);
+        if (m_sweep_timer != INVALID_TIMER_ID) {
+            loop()->killTimer(m_sweep_timer);
+            m_sweep_timer = INVALID_TIMER_ID;
+        }
+
+        m_alive.reset();
+    };
+
+    if (loop()->isInLoopThread() || !loop()->isRunning()) {
+        teardown();
+    } else {
+        std::promise<void> done;
+        loop()->queueInLoop([&]() {
+            teardown();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    // The queue does not own its frames.
+    while (auto* node = m_outbox.try_pop()) {
+        OutboundFrame::Deleter {}(static_cast<OutboundFrame*>(node));
+    }
+}
+
 int ProtooClient::connect(const std::string& url)
 {
     // reconnect: 1,2,4,8,10,10,10...
@@ -28,58 +93,228 @@ int ProtooClient::connect(const std::string& url)
 
 void ProtooClient::on_ws_open()
 {
-    std::scoped_lock lk(m_mutex);
-    for (auto& request : m_buffered_request) {
-        request();
-    }
+    // Everything sent while connecting is waiting in the outbox.
+    drain_outbox();
+}
 
-    m_buffered_request.clear();
+namespace {
+
+// Past this, the batch buffer gives the memory back after a write instead of keeping it for the next one.
+constexpr size_t kMaxRetainedBatch = size_t(1) << 20;
+
+/**
+ * Serializing and masking happen on the sending thread, each with its own writer and mask keys.
+ */
+ProtooWriter& local_writer()
+{
+    thread_local ProtooWriter writer;
+    return writer;
 }
 
-void ProtooClient::on_ws_message(const std::string& raw_msg)
+std::minstd_rand& local_mask_generator()
 {
-    nlohmann::json msg = nlohmann::json::parse(raw_msg);
-    if (!msg.is_object())
-        return;
+    thread_local std::minstd_rand generator(std::random_device {}());
+    return generator;
+}
+
+/**
+ * data stays a slice of the frame, the frame is copied once and owned by the message handed to the handler.
+ */
+LazyJson lazy_slice(const std::string& frame, std::string_view value)
+{
+    return LazyJson(frame, static_cast<size_t>(value.data() - frame.data()), value.size());
+}
+
+}
 
+void ProtooClient::on_ws_message(const std::string& raw_msg)
+{
     try {
-        if (msg.value("request", false)) {
-            ProtooRequest request;
-            msg.at("id").get_to(request.id);
-            msg.at("method").get_to(request.method);
-            msg.at("data").get_to(request.data);
-
-            if (on_request)
-                on_request(std::move(request));
-        } else if (msg.value("response", false)) {
-            ProtooResponse response;
-            msg.at("ok").get_to(response.ok);
-            msg.at("id").get_to(response.id);
+        auto envelope = scan_protoo_envelope(raw_msg);
+        if (!envelope)
+            return;
 
-            if (response.ok) {
-                msg.at("data").get_to(response.data);
-            } else {
-                msg.at("errorReason").get_to(response.error_reason);
+        switch (envelope->kind) {
+        case ProtooEnvelope::Kind::Request: {
+            if (!envelope->id || envelope->data.empty())
+                throw std::runtime_error("protoo: request without id or data");
+
+            if (on_request) {
+                on_request(ProtooRequest {
+                    .id = *envelope->id,
+                    .method = std::move(envelope->method),
+                    .data = lazy_slice(raw_msg, envelope->data),
+                });
             }
+            break;
+        }
+        case ProtooEnvelope::Kind::Response: {
+            if (!envelope->id)
+                throw std::runtime_error("protoo: response without id");
 
-            std::scoped_lock lk(m_mutex);
-            if (auto it = m_awaiting_response.find(response.id); it != m_awaiting_response.end()) {
-                loop()->killTimer(it->second.timeout);
-                it->second.promise->set_value(std::move(response));
+            ProtooResponse response;
+            response.ok = envelope->ok;
+            response.id = *envelope->id;
 
-                m_awaiting_response.erase(it);
-            }
-        } else if (msg.value("notification", false)) {
-            ProtooNotify notification;
-            msg.at("method").get_to(notification.method);
-            msg.at("data").get_to(notification.data);
+            // The caller wants the data anyway, parse just that slice.
+            auto value = envelope->ok ? envelope->data : envelope->error_reason;
+            if (value.empty())
+                throw std::runtime_error(envelope->ok ? "protoo: response without data" : "protoo: response without errorReason");
+
+            (envelope->ok ? response.data : response.error_reason) = nlohmann::json::parse(value.begin(), value.end());
+            complete(response.id, nullptr, std::move(response));
+            break;
+        }
+        case ProtooEnvelope::Kind::Notification: {
+            if (envelope->data.empty())
+                throw std::runtime_error("protoo: notification without data");
 
-            if (on_notify)
-                on_notify(std::move(notification));
+            if (on_notify) {
+                on_notify(ProtooNotify {
+                    .method = std::move(envelope->method),
+                    .data = lazy_slice(raw_msg, envelope->data),
+                });
+            }
+            break;
+        }
         }
     } catch (const std::exception& ex) {
-        cm::log("[ProtooClient][ERROR] {}", ex.what());
+        cm::log_rate_limited<cm::LogLevel::Error>({}, "[ProtooClient][ERROR] {}", ex.what());
+    }
+}
+
+void ProtooClient::close()
+{
+    hv::WebSocketClient::close();
+
+    // Frames still queued belong to this connection, the next drain drops them.
+    m_epoch.fetch_add(1, std::memory_order_acq_rel);
+
+    std::vector<PendingRequest> pending;
+    {
+        std::scoped_lock lk(m_mutex);
+        // Slots keep their generation, so a response arriving late for one of these never matches a later request.
+        for (size_t slot = 0; slot < m_pending.size(); slot++) {
+            PendingRequest request;
+            if (m_pending[slot].active && take_pending(id_of(slot), request))
+                pending.push_back(std::move(request));
+        }
+
+        m_timeouts = cm::TimerWheel<std::monostate>(now_tick());
+
+        if (m_sweep_timer != INVALID_TIMER_ID) {
+            loop()->killTimer(m_sweep_timer);
+            m_sweep_timer = INVALID_TIMER_ID;
+        }
+    }
+
+    for (auto& request : pending) {
+        request.callback(std::make_exception_ptr(std::runtime_error("connection closed")), ProtooResponse {});
+    }
+}
+
+void ProtooClient::complete(uint64_t id, std::exception_ptr error, ProtooResponse response)
+{
+    PendingRequest request;
+    {
+        std::scoped_lock lk(m_mutex);
+        if (!take_pending(id, request))
+            return;
+
+        m_timeouts.cancel(id);
+    }
+
+    // Outside the lock, the callback may resume a coroutine that sends the next request.
+    request.callback(std::move(error), std::move(response));
+}
+
+void ProtooClient::sweep_timeouts()
+{
+    std::vector<PendingRequest> expired;
+    {
+        std::scoped_lock lk(m_mutex);
+        m_timeouts.advance(now_tick(), [&](cm::TimerId id, std::monostate) {
+            PendingRequest request;
+            if (take_pending(id, request))
+                expired.push_back(std::move(request));
+        });
+
+        if (m_timeouts.empty() && m_sweep_timer != INVALID_TIMER_ID) {
+            loop()->killTimer(m_sweep_timer);
+            m_sweep_timer = INVALID_TIMER_ID;
+        }
+    }
+
+    for (auto& request : expired) {
+        request.callback(std::make_exception_ptr(std::runtime_error("request timeout, method=" + request.method)), ProtooResponse {});
+    }
+}
+
+uint64_t ProtooClient::add_pending(std::string method, ResponseCallback callback, std::chrono::milliseconds timeout)
+{
+    uint32_t slot;
+    if (m_free_slots.empty()) {
+        if (m_pending.size() >= (size_t(1) << kSlotBits))
+            throw std::runtime_error("protoo: too many pending requests");
+
+        slot = static_cast<uint32_t>(m_pending.size());
+        m_pending.emplace_back();
+    } else {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
     }
+
+    auto& request = m_pending[slot];
+    request.active = true;
+    request.method = std::move(method);
+    request.callback = std::move(callback);
+
+    uint64_t id = id_of(slot);
+
+    // The wheel stands still while nothing is pending, catch up in one step instead of tick by tick.
+    if (m_timeouts.empty())
+        m_timeouts.advance(now_tick(), [](cm::TimerId, std::monostate) {});
+
+    // Rounded up, a request never times out early.
+    uint64_t deadline_tick = now_tick() + (static_cast<uint64_t>(std::max<int64_t>(timeout.count(), 0)) + kTickMs - 1) / kTickMs;
+    m_timeouts.schedule(id, deadline_tick, std::monostate {});
+
+    if (m_sweep_timer == INVALID_TIMER_ID)
+        m_sweep_timer = loop()->setInterval(kTickMs, [this, alive = std::weak_ptr(m_alive)](hv::TimerID) {
+            if (alive.lock())
+                sweep_timeouts();
+        });
+
+    return id;
+}
+
+bool ProtooClient::take_pending(uint64_t id, PendingRequest& request)
+{
+    uint64_t slot = id & ((uint64_t(1) << kSlotBits) - 1);
+    if (slot >= m_pending.size() || id != id_of(slot) || !m_pending[slot].active)
+        return false;
+
+    auto& pending = m_pending[slot];
+
+    request.method = std::move(pending.method);
+    request.callback = std::move(pending.callback);
+
+    pending.active = false;
+    pending.generation = (pending.generation + 1) & kGenerationMask;
+    m_free_slots.push_back(static_cast<uint32_t>(slot));
+    return true;
+}
+
+uint64_t ProtooClient::id_of(size_t slot) const
+{
+    // Generation 0 would make the first id 0.
+    return (uint64_t(m_pending[slot].generation + 1) << kSlotBits) | slot;
+}
+
+uint64_t ProtooClient::now_tick()
+{
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
+    return static_cast<uint64_t>(now.count()) / kTickMs;
 }
 
 void ProtooClient::on_ws_close() const
@@ -88,82 +323,145 @@ void ProtooClient::on_ws_close() const
         on_close();
 }
 
-void ProtooClient::notify(std::string method, nlohmann::json data)
+void ProtooClient::enqueue_frame(std::string_view payload)
 {
-    nlohmann::json body = {
-        { "notification", true },
-        { "method", std::move(method) },
-        { "data", std::move(data) },
-    };
+    // Client frames are masked, with a new key each.
+    uint32_t mask = static_cast<uint32_t>(local_mask_generator()());
+    char mask_key[4];
+    std::memcpy(mask_key, &mask, sizeof(mask_key));
 
-    auto raw_body = body.dump();
-    if (this->isConnected()) {
-        send(raw_body);
-    } else {
-        m_buffered_request.emplace_back([this, raw_body = std::move(raw_body)]() {
-            this->send(raw_body);
+    auto frame = OutboundFrame::create(ws_calc_frame_size(static_cast<int>(payload.size()), true), m_epoch.load(std::memory_order_acquire));
+    ws_build_frame(frame->bytes(), payload.data(), static_cast<int>(payload.size()), mask_key, true, WS_OPCODE_TEXT, true);
+
+    // Counted before the push, so the drain never takes off more than was added.
+    size_t size = frame->size;
+    size_t queued = m_queued_bytes.fetch_add(size, std::memory_order_acq_rel) + size;
+    m_outbox.push(frame.release());
+    schedule_drain();
+
+    // The frame that fills a batch does not wait out the latency budget, the drain still scheduled finds the rest.
+    if (m_coalescing.latency_budget.count() > 0 && queued >= m_coalescing.max_batch_bytes && queued - size < m_coalescing.max_batch_bytes)
+        post_drain();
+}
+
+void ProtooClient::schedule_drain()
+{
+    // After the push: either this schedules a drain, or the drain that clears the flag next sees the frame.
+    if (m_drain_scheduled.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    if (m_coalescing.latency_budget.count() > 0) {
+        loop()->setTimeout(static_cast<int>(m_coalescing.latency_budget.count()), [this, alive = std::weak_ptr(m_alive)](hv::TimerID) {
+            if (alive.lock())
+                drain_outbox();
         });
+    } else {
+        post_drain();
+    }
+}
+
+void ProtooClient::post_drain()
+{
+    loop()->queueInLoop([this, alive = std::weak_ptr(m_alive)]() {
+        if (alive.lock())
+            drain_outbox();
+    });
+}
+
+void ProtooClient::drain_outbox()
+{
+    m_drain_scheduled.exchange(false, std::memory_order_acq_rel);
+    if (!this->isConnected())
+        return;
+
+    while (auto* node = m_outbox.try_pop()) {
+        OutboundFrame::Ptr frame(static_cast<OutboundFrame*>(node));
+        m_queued_bytes.fetch_sub(frame->size, std::memory_order_acq_rel);
+        if (frame->epoch != m_epoch.load(std::memory_order_acquire))
+            continue;
+
+        m_batch.append(frame->bytes(), frame->size);
+        m_frames_written.fetch_add(1, std::memory_order_relaxed);
+        if (m_batch.size() >= m_coalescing.max_batch_bytes)
+            write_batch();
+    }
+
+    write_batch();
+}
+
+void ProtooClient::write_batch()
+{
+    if (m_batch.empty())
+        return;
+
+    if (channel && channel->isConnected()) {
+        channel->write(m_batch.data(), static_cast<int>(m_batch.size()));
+        m_writes.fetch_add(1, std::memory_order_relaxed);
     }
+
+    m_batch.clear();
+    if (m_batch.capacity() > kMaxRetainedBatch)
+        m_batch.shrink_to_fit();
 }
 
-std::future<ProtooResponse> ProtooClient::request(std::string method, nlohmann::json data)
+void ProtooClient::set_write_coalescing(WriteCoalescing options)
 {
-    auto ret = std::make_shared<std::promise<ProtooResponse>>();
+    m_coalescing = options;
+}
 
-    uint64_t id = m_request_id_gen.fetch_add(1);
-    nlohmann::json body = {
-        { "request", true },
-        { "id", id },
-        { "method", std::move(method) },
-        { "data", std::move(data) },
+ProtooClient::WriteStats ProtooClient::write_stats()
+{
+    return WriteStats {
+        .frames = m_frames_written.load(std::memory_order_relaxed),
+        .writes = m_writes.load(std::memory_order_relaxed),
     };
+}
+
+void ProtooClient::notify(std::string method, nlohmann::json data)
+{
+    enqueue_frame(local_writer().notification(method, data));
+}
 
-    auto timeout = loop()->setTimeout(10000, [=](auto) {
-        ret->set_exception(std::make_exception_ptr(std::runtime_error("request timeout, method=" + method)));
+std::future<ProtooResponse> ProtooClient::request(std::string method, nlohmann::json data, std::chrono::milliseconds timeout)
+{
+    std::promise<ProtooResponse> promise;
+    auto future = promise.get_future();
 
-        std::scoped_lock lk(m_mutex);
-        m_awaiting_response.erase(id);
-    });
+    requestAsync(
+        std::move(method), std::move(data), [promise = std::move(promise)](std::exception_ptr error, ProtooResponse response) mutable {
+            if (error) {
+                promise.set_exception(std::move(error));
+            } else {
+                promise.set_value(std::move(response));
+            }
+        },
+        timeout);
+
+    return future;
+}
 
+void ProtooClient::requestAsync(std::string method, nlohmann::json data, ResponseCallback callback, std::chrono::milliseconds timeout)
+{
+    // Registered before it is sent so the response always finds it.
+    uint64_t id;
     {
         std::scoped_lock lk(m_mutex);
-        m_awaiting_response.insert({ id, PendingRequest { ret, timeout } });
+        id = add_pending(method, std::move(callback), timeout);
     }
 
-    auto raw_body = body.dump();
-    if (this->isConnected()) {
-        send(raw_body);
-    } else {
-        m_buffered_request.emplace_back([this, raw_body = std::move(raw_body)]() {
-            this->send(raw_body);
-        });
-    }
+    enqueue_frame(local_writer().request(static_cast<int64_t>(id), method, data));
+}
 
-    return ret->get_future();
+cm::Async<ProtooResponse> ProtooClient::co_request(std::string method, nlohmann::json data, std::chrono::milliseconds timeout)
+{
+    return cm::Async<ProtooResponse>([this, method = std::move(method), data = std::move(data), timeout](ResponseCallback callback) mutable {
+        requestAsync(std::move(method), std::move(data), std::move(callback), timeout);
+    });
 }
 
 void ProtooClient::response(ProtooResponse response)
 {
-    nlohmann::json body;
-    if (response.ok) {
-        body = {
-            { "response", true },
-            { "ok", true },
-            { "id", response.id },
-            { "method", "ws-response" },
-            { "data", std::move(response.data) },
-        };
-    } else {
-        body = {
-            { "response", true },
-            { "ok", false },
-            { "id", response.id },
-            { "method", "ws-response" },
-            { "errorReason", std::move(response.error_reason) },
-        };
-    }
-
-    auto raw_body = body.dump();
-    send(raw_body);
+    auto& writer = local_writer();
+    enqueue_frame(response.ok ? writer.response(response.id, response.data) : writer.error_response(response.id, response.error_reason));
 }
 }
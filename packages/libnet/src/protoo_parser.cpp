@@ -0,0 +1,203 @@
+#include "net/protoo_parser.hpp"
+
+#include <charconv>
+#include <stdexcept>
+
+namespace net {
+
+namespace {
+
+class Scanner {
+public:
+    explicit Scanner(std::string_view text)
+        : m_text(text)
+    {
+    }
+
+    void skip_whitespace() noexcept
+    {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+            m_pos++;
+    }
+
+    bool consume(char c) noexcept
+    {
+        skip_whitespace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail("expected '" + std::string(1, c) + "'");
+    }
+
+    /**
+     * @return The raw content of a string, escapes left as they are.
+     */
+    std::string_view string()
+    {
+        skip_whitespace();
+        size_t begin = m_pos;
+        skip_string();
+        return m_text.substr(begin + 1, m_pos - begin - 2);
+    }
+
+    /**
+     * @return The raw text of any value.
+     */
+    std::string_view value()
+    {
+        skip_whitespace();
+        if (m_pos >= m_text.size())
+            fail("unexpected end");
+
+        size_t begin = m_pos;
+        switch (m_text[m_pos]) {
+        case '"':
+            skip_string();
+            break;
+        case '{':
+        case '[':
+            skip_nested();
+            break;
+        default:
+            while (m_pos < m_text.size() && !is_delimiter(m_text[m_pos]))
+                m_pos++;
+            break;
+        }
+
+        return m_text.substr(begin, m_pos - begin);
+    }
+
+    [[noreturn]] void fail(const std::string& what) const
+    {
+        throw std::runtime_error("protoo: " + what + " at offset " + std::to_string(m_pos));
+    }
+
+private:
+    static bool is_delimiter(char c) noexcept
+    {
+        return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void skip_string()
+    {
+        if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+            fail("expected string");
+
+        for (m_pos++; m_pos < m_text.size(); m_pos++) {
+            if (m_text[m_pos] == '\\') {
+                m_pos++;
+            } else if (m_text[m_pos] == '"') {
+                m_pos++;
+                return;
+            }
+        }
+
+        fail("unterminated string");
+    }
+
+    void skip_nested()
+    {
+        size_t depth = 0;
+        while (m_pos < m_text.size()) {
+            switch (m_text[m_pos]) {
+            case '"':
+                skip_string();
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0) {
+                    m_pos++;
+                    return;
+                }
+                break;
+            default:
+                break;
+            }
+
+            m_pos++;
+        }
+
+        fail("unterminated value");
+    }
+
+private:
+    std::string_view m_text;
+    size_t m_pos { 0 };
+};
+
+}
+
+std::optional<ProtooEnvelope> scan_protoo_envelope(std::string_view message)
+{
+    Scanner scanner(message);
+    scanner.expect('{');
+
+    bool request = false;
+    bool response = false;
+    bool notification = false;
+    ProtooEnvelope envelope { .kind = ProtooEnvelope::Kind::Request };
+
+    if (!scanner.consume('}')) {
+        do {
+            auto key = scanner.string();
+            scanner.expect(':');
+            auto value = scanner.value();
+
+            if (key == "request") {
+                request = value == "true";
+            } else if (key == "response") {
+                response = value == "true";
+            } else if (key == "notification") {
+                notification = value == "true";
+            } else if (key == "ok") {
+                envelope.ok = value == "true";
+            } else if (key == "id") {
+                int64_t id = 0;
+                auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), id);
+                if (error != std::errc() || end != value.data() + value.size())
+                    scanner.fail("invalid id");
+
+                envelope.id = id;
+            } else if (key == "method") {
+                if (value.size() < 2 || value.front() != '"')
+                    scanner.fail("invalid method");
+
+                auto method = value.substr(1, value.size() - 2);
+                // Method names are plain identifiers, only pay for unescaping when there is something to unescape.
+                envelope.method = method.find('\\') == std::string_view::npos ? std::string(method) : nlohmann::json::parse(value).get<std::string>();
+            } else if (key == "data") {
+                envelope.data = value;
+            } else if (key == "errorReason") {
+                envelope.error_reason = value;
+            }
+        } while (scanner.consume(','));
+
+        scanner.expect('}');
+    }
+
+    if (request) {
+        envelope.kind = ProtooEnvelope::Kind::Request;
+    } else if (response) {
+        envelope.kind = ProtooEnvelope::Kind::Response;
+    } else if (notification) {
+        envelope.kind = ProtooEnvelope::Kind::Notification;
+    } else {
+        return std::nullopt;
+    }
+
+    return envelope;
+}
+
+}
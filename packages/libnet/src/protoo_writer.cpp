@@ -0,0 +1,107 @@
+#include "net/protoo_writer.hpp"
+
+#include <charconv>
+
+namespace net {
+
+namespace {
+
+// A frame this large is rare enough that the buffer gives the memory back instead of keeping it for the next one.
+constexpr size_t kMaxRetainedCapacity = size_t(1) << 20;
+
+constexpr std::string_view kResponsePrefix = R"({"response":true,"ok":true,"method":"ws-response","id":)";
+constexpr std::string_view kErrorResponsePrefix = R"({"response":true,"ok":false,"method":"ws-response","id":)";
+
+}
+
+ProtooWriter::ProtooWriter()
+    : m_serializer(std::make_unique<nlohmann::detail::serializer<nlohmann::json>>(
+        std::make_shared<nlohmann::detail::output_string_adapter<char>>(m_buffer), ' '))
+{
+}
+
+ProtooWriter::~ProtooWriter() = default;
+
+const std::string& ProtooWriter::request(int64_t id, std::string_view method, const nlohmann::json& data)
+{
+    begin();
+    append_prefix(m_request_prefixes, "request", method, "id");
+    append_id(id);
+
+    m_buffer.append(R"(,"data":)");
+    append_value(data);
+    m_buffer.push_back('}');
+    return m_buffer;
+}
+
+const std::string& ProtooWriter::notification(std::string_view method, const nlohmann::json& data)
+{
+    begin();
+    append_prefix(m_notification_prefixes, "notification", method, "data");
+    append_value(data);
+    m_buffer.push_back('}');
+    return m_buffer;
+}
+
+const std::string& ProtooWriter::response(int64_t id, const nlohmann::json& data)
+{
+    begin();
+    m_buffer.append(kResponsePrefix);
+    append_id(id);
+
+    m_buffer.append(R"(,"data":)");
+    append_value(data);
+    m_buffer.push_back('}');
+    return m_buffer;
+}
+
+const std::string& ProtooWriter::error_response(int64_t id, const nlohmann::json& error_reason)
+{
+    begin();
+    m_buffer.append(kErrorResponsePrefix);
+    append_id(id);
+
+    m_buffer.append(R"(,"errorReason":)");
+    append_value(error_reason);
+    m_buffer.push_back('}');
+    return m_buffer;
+}
+
+void ProtooWriter::begin()
+{
+    m_buffer.clear();
+    if (m_buffer.capacity() > kMaxRetainedCapacity)
+        m_buffer.shrink_to_fit();
+}
+
+void ProtooWriter::append_prefix(PrefixCache& cache, std::string_view kind, std::string_view method, std::string_view next_key)
+{
+    auto it = cache.find(method);
+    if (it == cache.end()) {
+        // {"<kind>":true,"method":"<method>","<next_key>":
+        std::string prefix = "{\"";
+        prefix.append(kind);
+        prefix.append("\":true,\"method\":");
+        prefix.append(nlohmann::json(method).dump());
+        prefix.append(",\"");
+        prefix.append(next_key);
+        prefix.append("\":");
+        it = cache.emplace(std::string(method), std::move(prefix)).first;
+    }
+
+    m_buffer.append(it->second);
+}
+
+void ProtooWriter::append_id(int64_t id)
+{
+    char digits[24];
+    auto end = std::to_chars(std::begin(digits), std::end(digits), id).ptr;
+    m_buffer.append(digits, end);
+}
+
+void ProtooWriter::append_value(const nlohmann::json& value)
+{
+    m_serializer->dump(value, false, false, 0);
+}
+
+}
@@ -1,6 +1,5 @@
 #include "conference.hpp"
-
-#include "timer_event_loop.hpp"
+#include "ramp.hpp"
 
 static constexpr bool USE_LIVE_SERVER = true;
 static const std::string WS_ENDPOINT = USE_LIVE_SERVER ? "ws://45.127.252.204:12009" : "ws://portal-mediasoup-dev.service.zingplay.com:11905";
@@ -8,88 +7,202 @@ static const std::string HTTP_ENDPOINT = USE_LIVE_SERVER ? "http://45.127.252.20
 
 ConferencePeer::ConferencePeer(
     std::shared_ptr<cm::Executor> executor,
+    std::shared_ptr<cm::Executor> produce_executor,
     hv::EventLoopPtr event_loop,
     std::shared_ptr<net::HttpClient> http_client,
-    std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory)
-    : m_executor(std::move(executor))
+    std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory,
+    std::shared_ptr<JoinTimings> join_timings)
+    : m_strand(*executor)
+    , m_produce_executor(std::move(produce_executor))
     , m_event_loop(event_loop)
     , m_protoo(event_loop)
     , m_http_client(http_client)
     , m_peer_connection_factory(std::move(peer_connection_factory))
+    , m_join_timings(std::move(join_timings))
 {
     m_device = msc::Device::create(this, m_peer_connection_factory);
     m_protoo.on_notify = [this](net::ProtooNotify req) {
-        m_executor->push_task([this, req = std::move(req)]() {
+        m_strand.push_task([this, req = std::move(req)]() mutable {
             on_protoo_notify(std::move(req));
         });
     };
     m_protoo.on_request = [this](net::ProtooRequest req) {
-        m_executor->push_task([this, req = std::move(req)]() {
+        m_strand.push_task([this, req = std::move(req)]() mutable {
             on_protoo_request(std::move(req));
         });
     };
+
+    // Every peer ticks on its own phase, so thousands of peers do not all produce in the same millisecond.
+    m_tick_producer_timer = m_strand.schedule_every(std::chrono::milliseconds(50), [this]() {
+        tick_producer();
+    });
 }
 
 ConferencePeer::~ConferencePeer()
 {
+    m_strand.cancel_timer(m_tick_producer_timer);
     leave(true);
+
+    // leave() failed the join's pending requests, wait for it to unwind before the strand state goes away.
+    if (m_join.valid())
+        m_join.wait();
 }
 
-void ConferencePeer::joinRoom(std::string user_id, std::string room_id)
+void ConferencePeer::joinRoom(std::string user_id, std::string room_id, std::function<void()> on_finished)
 {
     m_user_id = std::move(user_id);
     m_room_id = std::move(room_id);
     m_state.produce_success = false;
 
-    m_executor->push_task([this]() {
-        try {
-            auto auth_response = m_http_client->get(HTTP_ENDPOINT + "/api/conference/__internalRouteForTestPurpose_REMOVE_IN_PROD?uid=" + m_user_id).get();
-            auto auth_json = auth_response->GetJson();
-
-            m_protoo.connect(WS_ENDPOINT + "/conference/connect?rid=" + m_room_id + "&token=" + auth_json.at("data").get<std::string>());
-
-            request("join", {
-                                { "roomId", m_room_id },
-                                { "deviceId", "BOT1111" },
-                                { "deviceModel", "Linux" },
-                                { "networkType", "LAN" },
-                                { "gameId", "werewolf" },
-                                { "cameraResolution", "TODO" },
-                            });
-
-            auto routerRtpCapabilities = request("getRouterRtpCapabilities", {});
-
-            m_device->load(routerRtpCapabilities);
-            m_create_transport_option = request("createWebRtcTransport", {});
-            m_device->ensure_transport(msc::TransportKind::Send);
-            m_device->ensure_transport(msc::TransportKind::Recv);
-
-            auto consumer_infos = request("consumeAllExistingProducer", { { "rtpCapabilities", m_device->rtp_capabilities() } });
-            start_consuming(consumer_infos);
-
-            m_self_audio_sender = m_device->create_audio_source(msc::ProducerOptions {
-                .encodings = nullptr,
-                .codec_options = {
-                    { "opusStereo", true },
-                    { "opusDtx", true },
-                },
-                .codec = nullptr });
-
-            m_self_data_sender = m_device->create_data_source("virtual-avatar", "", false, 0, 0);
-            m_state.produce_success = true;
-        } catch (...) {
+    auto task = join(++m_join_generation);
+    if (on_finished) {
+        m_join = cm::spawn(m_strand, notify_when_done(std::move(task), std::move(on_finished)));
+    } else {
+        m_join = cm::spawn(m_strand, std::move(task));
+    }
+}
+
+cm::Task<void> ConferencePeer::join(uint64_t generation)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto cancelled = [this, generation]() { return generation != m_join_generation.load(); };
+    auto join_started = Clock::now();
+    auto record = [this](JoinStage stage, Clock::time_point started) {
+        m_join_timings->record(stage, Clock::now() - started);
+    };
+
+    try {
+        auto auth_response = co_await m_http_client->co_get(HTTP_ENDPOINT + "/api/conference/__internalRouteForTestPurpose_REMOVE_IN_PROD?uid=" + m_user_id);
+        if (cancelled())
+            co_return;
+
+        // nullptr once the request failed or its deadline passed.
+        if (!auth_response) {
+            m_state.status = ConferenceStatus::Exception;
+            cm::log_error("[Conference][{}][ERROR] join failed: auth request failed", m_user_id);
+            co_return;
+        }
+
+        record(JoinStage::Auth, join_started);
+        auto auth_json = auth_response->GetJson();
+
+        m_protoo.connect(WS_ENDPOINT + "/conference/connect?rid=" + m_room_id + "&token=" + auth_json.at("data").get<std::string>());
+
+        nlohmann::json join_body = {
+            { "roomId", m_room_id },
+            { "deviceId", "BOT1111" },
+            { "deviceModel", "Linux" },
+            { "networkType", "LAN" },
+            { "gameId", "werewolf" },
+            { "cameraResolution", "TODO" },
+        };
+
+        // The router capabilities do not depend on having joined, both go out together, queued until the socket opens.
+        auto signaling_started = Clock::now();
+        auto join_request = start_request("join", std::move(join_body));
+        auto capabilities_request = start_request("getRouterRtpCapabilities", {});
+
+        response_data(co_await std::move(join_request));
+        if (cancelled())
+            co_return;
+
+        record(JoinStage::Join, signaling_started);
+
+        // The server transports are created while the device loads the capabilities.
+        auto transport_started = Clock::now();
+        auto transport_request = start_request("createWebRtcTransport", {});
+
+        auto router_capabilities = response_data(co_await std::move(capabilities_request));
+        if (cancelled())
+            co_return;
+
+        record(JoinStage::RouterCapabilities, signaling_started);
+
+        auto load_started = Clock::now();
+        m_device->load(router_capabilities);
+        record(JoinStage::LoadDevice, load_started);
+
+        m_create_transport_option = response_data(co_await std::move(transport_request));
+        if (cancelled())
+            co_return;
+
+        record(JoinStage::CreateTransport, transport_started);
+        m_device->ensure_transport(msc::TransportKind::Send);
+        m_device->ensure_transport(msc::TransportKind::Recv);
+
+        // Existing producers are fetched while this peer produces, consuming only needs the recv transport.
+        auto consume_started = Clock::now();
+        nlohmann::json consume_body = { { "rtpCapabilities", m_device->rtp_capabilities() } };
+        auto consume_request = start_request("consumeAllExistingProducer", std::move(consume_body));
+
+        auto produce_started = Clock::now();
+        auto producers = co_await produce(generation);
+        if (cancelled())
+            co_return;
+
+        m_self_audio_sender = std::move(producers.audio);
+        m_self_data_sender = std::move(producers.data);
+        m_state.produce_success = true;
+        record(JoinStage::Produce, produce_started);
+
+        auto consumer_infos = response_data(co_await std::move(consume_request));
+        if (cancelled())
+            co_return;
+
+        start_consuming(consumer_infos);
+        record(JoinStage::Consume, consume_started);
+        record(JoinStage::Total, join_started);
+    } catch (const std::exception& ex) {
+        if (!cancelled()) {
             m_state.status = ConferenceStatus::Exception;
-            std::rethrow_exception(std::current_exception());
+            cm::log_error("[Conference][{}][ERROR] join failed: {}", m_user_id, ex.what());
         }
+    }
+}
+
+cm::Async<ConferencePeer::Producers> ConferencePeer::produce(uint64_t generation)
+{
+    return cm::Async<Producers>([this, generation](cm::Async<Producers>::Callback callback) {
+        m_produce_executor->push_task([this, generation, callback = std::move(callback)]() mutable {
+            Producers producers;
+            std::exception_ptr error;
+            try {
+                std::scoped_lock lk(m_produce_mutex);
+                if (generation == m_join_generation.load()) {
+                    producers.audio = m_device->create_audio_source(msc::ProducerOptions {
+                        .encodings = nullptr,
+                        .codec_options = {
+                            { "opusStereo", true },
+                            { "opusDtx", true },
+                        },
+                        .codec = nullptr });
+
+                    producers.data = m_device->create_data_source("virtual-avatar", "", false, 0, 0);
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            callback(std::move(error), std::move(producers));
+        });
     });
 }
 
 void ConferencePeer::leave(bool blocking)
 {
-    auto fut = m_executor->submit([this]() {
+    m_join_generation++;
+
+    auto fut = m_strand.submit([this]() {
         m_protoo.close();
-        m_device->stop();
+        {
+            // A produce() in flight fails fast once protoo is closed, the device is stopped after it returns.
+            std::scoped_lock lk(m_produce_mutex);
+            m_device->stop();
+        }
+
         m_peers.clear();
+        m_sinks.clear();
         m_self_audio_sender.reset();
         m_self_data_sender.reset();
         m_state.status = ConferenceStatus::Idle;
@@ -121,83 +234,82 @@ ConferenceState ConferencePeer::state()
 
 void ConferencePeer::tick_producer()
 {
-    m_executor->push_task([this]() {
-        {
-            m_buffer.resize(1760);
-            std::generate(m_buffer.begin(), m_buffer.end(), []() { return std::rand() % 256; });
-        }
-
-        if (m_self_data_sender && m_self_data_sender->buffered_amount() == 0) {
-            std::span data(m_buffer.begin(), 300);
-            if (m_validate_data_channel) {
-                cm::CRC32 crc32;
-                crc32.update(data.subspan(4));
-                uint32_t checksum = crc32.digest();
-                std::memcpy(data.data(), &checksum, sizeof(checksum));
-            }
+    {
+        m_buffer.resize(1760);
+        std::generate(m_buffer.begin(), m_buffer.end(), []() { return std::rand() % 256; });
+    }
 
-            m_state.data_producer_tick_count++;
-            m_self_data_sender->send_data(data);
+    if (m_self_data_sender && m_self_data_sender->buffered_amount() == 0) {
+        std::span data(m_buffer.begin(), 300);
+        if (m_validate_data_channel) {
+            cm::CRC32 crc32;
+            crc32.update(data.subspan(4));
+            uint32_t checksum = crc32.digest();
+            std::memcpy(data.data(), &checksum, sizeof(checksum));
         }
 
-        // this will be called every 10ms, so sending 440 frames every 10ms will be 44000Hz
-        if (m_self_audio_sender) {
-            msc::MutableAudioData audio_data;
-            audio_data.timestamp_ms = msc::rtc_timestamp_ms();
-            audio_data.bits_per_sample = 16;
-            audio_data.sample_rate = 44000;
-            audio_data.number_of_channels = 2;
-            audio_data.number_of_frames = 440;
-            audio_data.data = m_buffer.data();
-            m_self_audio_sender->send_audio_data(audio_data);
-        }
-    });
+        m_state.data_producer_tick_count++;
+        m_self_data_sender->send_data(data);
+    }
+
+    // this will be called every 10ms, so sending 440 frames every 10ms will be 44000Hz
+    if (m_self_audio_sender) {
+        msc::MutableAudioData audio_data;
+        audio_data.timestamp_ms = msc::rtc_timestamp_ms();
+        audio_data.bits_per_sample = 16;
+        audio_data.sample_rate = 44000;
+        audio_data.number_of_channels = 2;
+        audio_data.number_of_frames = 440;
+        audio_data.data = m_buffer.data();
+        m_self_audio_sender->send_audio_data(audio_data);
+    }
 }
 
-void ConferencePeer::start_consuming(nlohmann::json consumer_infos)
+template<typename Json>
+void ConferencePeer::start_consuming(const Json& consumer_infos)
 {
     for (const auto& consumer_info : consumer_infos) {
-        const auto& peer_id = consumer_info.at("userId").get<std::string>();
-        const auto& consumer_id = consumer_info.at("consumerId").get<std::string>();
-        const auto& producer_id = consumer_info.at("producerId").get<std::string>();
-        const auto& producer_type = consumer_info.at("producerType").get<std::string>();
+        const auto& peer_id = consumer_info.at("userId").template get<std::string>();
+        const auto& consumer_id = consumer_info.at("consumerId").template get<std::string>();
+        const auto& producer_id = consumer_info.at("producerId").template get<std::string>();
+        const auto& producer_type = consumer_info.at("producerType").template get<std::string>();
 
         auto& peer = m_peers[peer_id];
         if (producer_type == "data") {
-            auto stream_id = consumer_info.at("streamId").get<int16_t>();
-            const auto& label = consumer_info.at("label").get<std::string>();
-            const auto& protocol = consumer_info.at("protocol").get<std::string>();
+            auto stream_id = consumer_info.at("streamId").template get<int16_t>();
+            const auto& label = consumer_info.at("label").template get<std::string>();
+            const auto& protocol = consumer_info.at("protocol").template get<std::string>();
 
-            cm::log("[Conference][{}] start consuming data from {}: consumer_id={} producer_id={} stream_id={} label={}", m_user_id, peer_id, consumer_id, producer_id, stream_id, label);
+            cm::log_debug("[Conference][{}] start consuming data from {}: consumer_id={} producer_id={} stream_id={} label={}", m_user_id, peer_id, consumer_id, producer_id, stream_id, label);
             if (!peer.data_consumer) {
                 peer.data_consumer = std::make_shared<ReportDataConsumer>(m_validate_data_channel);
             }
 
-            m_device->create_data_sink(consumer_id, producer_id, stream_id, label, protocol, peer.data_consumer);
+            m_sinks[consumer_id] = m_device->create_data_sink(consumer_id, producer_id, stream_id, label, protocol, peer.data_consumer);
         } else {
             const std::string kind = producer_type == "audio" ? "audio" : "video";
-            auto rtp_parameters = consumer_info.at("rtpParameters");
+            const auto& rtp_parameters = consumer_info.at("rtpParameters");
 
-            cm::log("[Conference][{}] start consuming {} from {}: consumer_id={} producer_id={}", m_user_id, kind, peer_id, consumer_id, producer_id);
+            cm::log_debug("[Conference][{}] start consuming {} from {}: consumer_id={} producer_id={}", m_user_id, kind, peer_id, consumer_id, producer_id);
             if (kind == "audio") {
                 if (!peer.audio_consumer) {
                     peer.audio_consumer = std::make_shared<msc::DummyAudioConsumer>();
                 }
 
-                m_device->create_audio_sink(msc::ConsumerOptions {
-                                                .consumer_id = consumer_id,
-                                                .producer_id = producer_id,
-                                                .rtp_parameters = rtp_parameters },
+                m_sinks[consumer_id] = m_device->create_audio_sink(msc::ConsumerOptions {
+                                                                       .consumer_id = consumer_id,
+                                                                       .producer_id = producer_id,
+                                                                       .rtp_parameters = rtp_parameters },
                     peer.audio_consumer);
             } else {
                 if (!peer.video_consumer) {
                     peer.video_consumer = std::make_shared<ReportVideoConsumer>();
                 }
 
-                m_device->create_video_sink(msc::ConsumerOptions {
-                                                .consumer_id = consumer_id,
-                                                .producer_id = producer_id,
-                                                .rtp_parameters = rtp_parameters },
+                m_sinks[consumer_id] = m_device->create_video_sink(msc::ConsumerOptions {
+                                                                       .consumer_id = consumer_id,
+                                                                       .producer_id = producer_id,
+                                                                       .rtp_parameters = rtp_parameters },
                     peer.video_consumer);
             }
         }
@@ -213,34 +325,56 @@ void ConferencePeer::on_protoo_notify(net::ProtooNotify req)
     } else if (req.method == "consumerPaused") {
 
     } else if (req.method == "consumerResumed") {
+
+    } else if (req.method == "consumerClosed" || req.method == "dataConsumerClosed") {
+        const auto& data = req.data.json();
+        const char* key = req.method == "consumerClosed" ? "consumerId" : "dataConsumerId";
+        if (data.contains(key))
+            close_sink(data.at(key).get<std::string>());
     }
 }
 
+void ConferencePeer::close_sink(const std::string& consumer_id)
+{
+    auto it = m_sinks.find(consumer_id);
+    if (it == m_sinks.end())
+        return;
+
+    m_device->close_sink(it->second);
+    m_sinks.erase(it);
+}
+
 void ConferencePeer::on_protoo_request(net::ProtooRequest req)
 {
+    // The message is only needed until the consumer exists, keep its DOM in an arena dropped in one go.
+    cm::JsonArena arena;
+    cm::JsonArenaScope arena_scope(arena);
+
     if (req.method == "newConsumer") {
-        start_consuming(nlohmann::json::array({
+        auto data = req.data.parse_as<cm::ArenaJson>();
+        start_consuming(cm::ArenaJson::array({
             {
-                { "userId", req.data.at("userId") },
-                { "consumerId", req.data.at("consumerId") },
-                { "producerId", req.data.at("producerId") },
-                { "producerType", req.data.at("kind") },
-                { "rtpParameters", req.data.at("rtpParameters") },
-                { "producerPaused", req.data.at("producerPaused") },
+                { "userId", std::move(data.at("userId")) },
+                { "consumerId", std::move(data.at("consumerId")) },
+                { "producerId", std::move(data.at("producerId")) },
+                { "producerType", std::move(data.at("kind")) },
+                { "rtpParameters", std::move(data.at("rtpParameters")) },
+                { "producerPaused", std::move(data.at("producerPaused")) },
             },
         }));
 
         m_protoo.response(req.ok({}));
     } else if (req.method == "newDataConsumer") {
-        start_consuming(nlohmann::json::array({
+        auto data = req.data.parse_as<cm::ArenaJson>();
+        start_consuming(cm::ArenaJson::array({
             {
-                { "userId", req.data.at("userId") },
-                { "consumerId", req.data.at("consumerId") },
-                { "producerId", req.data.at("producerId") },
+                { "userId", std::move(data.at("userId")) },
+                { "consumerId", std::move(data.at("consumerId")) },
+                { "producerId", std::move(data.at("producerId")) },
                 { "producerType", "data" },
-                { "streamId", req.data.at("streamId") },
-                { "label", req.data.at("label") },
-                { "protocol", req.data.at("protocol") },
+                { "streamId", std::move(data.at("streamId")) },
+                { "label", std::move(data.at("label")) },
+                { "protocol", std::move(data.at("protocol")) },
             },
         }));
 
@@ -265,36 +399,35 @@ msc::CreateTransportOptions ConferencePeer::create_server_side_transport(msc::Tr
     return options;
 }
 
-void ConferencePeer::connect_transport(msc::TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters)
+std::future<void> ConferencePeer::connect_transport_async(msc::TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters)
 {
     (void)transport_id;
-    request("connectWebRtcTransport", {
-                                          { "isSend", kind == msc::TransportKind::Send },
-                                          { "dtlsParameters", dtls_parameters },
-                                      });
+    return request_async<void>("connectWebRtcTransport", {
+                                                             { "isSend", kind == msc::TransportKind::Send },
+                                                             { "dtlsParameters", dtls_parameters },
+                                                         },
+        [](const nlohmann::json&) {});
 }
 
-std::string ConferencePeer::connect_producer(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters)
+std::future<std::string> ConferencePeer::connect_producer_async(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters)
 {
     (void)transport_id;
-    auto resp = request("produce", {
-                                       { "kind", kind == msc::MediaKind::Audio ? "audio" : "video" },
-                                       { "rtpParameters", rtp_parameters },
-                                   });
-
-    return resp.at("producerId").get<std::string>();
+    return request_async<std::string>("produce", {
+                                                     { "kind", kind == msc::MediaKind::Audio ? "audio" : "video" },
+                                                     { "rtpParameters", rtp_parameters },
+                                                 },
+        [](const nlohmann::json& resp) { return resp.at("producerId").get<std::string>(); });
 }
 
-std::string ConferencePeer::connect_data_producer(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol)
+std::future<std::string> ConferencePeer::connect_data_producer_async(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol)
 {
     (void)transport_id;
-    auto resp = request("produceData", {
-                                           { "label", label },
-                                           { "protocol", protocol },
-                                           { "sctpStreamParameters", sctp_parameters },
-                                       });
-
-    return resp.at("producerId").get<std::string>();
+    return request_async<std::string>("produceData", {
+                                                         { "label", label },
+                                                         { "protocol", protocol },
+                                                         { "sctpStreamParameters", sctp_parameters },
+                                                     },
+        [](const nlohmann::json& resp) { return resp.at("producerId").get<std::string>(); });
 }
 
 void ConferencePeer::on_connection_state_change(msc::TransportKind, const std::string&, const std::string& connection_state) noexcept
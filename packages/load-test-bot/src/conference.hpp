@@ -1,13 +1,22 @@
 #pragma once
 
 #include <common/executor.hpp>
+#include <common/histogram.hpp>
+#include <common/json_arena.hpp>
 #include <common/logger.hpp>
+#include <common/strand.hpp>
+#include <common/task.hpp>
 #include <msc/msc.hpp>
 #include <net/http_client.hpp>
 #include <net/protoo.hpp>
 
 #include "./consumer.hpp"
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
 enum class ConferenceStatus {
     Idle,
     New,
@@ -28,6 +37,57 @@ struct ConferenceState {
     bool produce_success { false };
 };
 
+enum class JoinStage {
+    Auth,
+    Join,
+    RouterCapabilities,
+    LoadDevice,
+    CreateTransport,
+    Produce,
+    Consume,
+    // From the start of the join until the peer both produces and consumes.
+    Total,
+};
+
+inline constexpr size_t kJoinStageCount = size_t(JoinStage::Total) + 1;
+
+/**
+ * How long each stage of a join took, in milliseconds, shared by every peer of a manager.
+ * Stages overlap, each one is timed from when it was issued until its result arrived.
+ */
+struct JoinTimings {
+    std::array<cm::Histogram, kJoinStageCount> stages {};
+
+    void record(JoinStage stage, std::chrono::steady_clock::duration elapsed)
+    {
+        stages[size_t(stage)].record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()));
+    }
+
+    static const char* name(JoinStage stage)
+    {
+        switch (stage) {
+        case JoinStage::Auth:
+            return "auth";
+        case JoinStage::Join:
+            return "join";
+        case JoinStage::RouterCapabilities:
+            return "caps";
+        case JoinStage::LoadDevice:
+            return "load";
+        case JoinStage::CreateTransport:
+            return "transport";
+        case JoinStage::Produce:
+            return "produce";
+        case JoinStage::Consume:
+            return "consume";
+        case JoinStage::Total:
+            return "total";
+        }
+
+        return "";
+    }
+};
+
 class ConferencePeer : public msc::DeviceDelegate
     , public std::enable_shared_from_this<ConferencePeer> {
 private:
@@ -37,13 +97,23 @@ private:
         std::shared_ptr<ReportDataConsumer> data_consumer { nullptr };
     };
 
-    std::shared_ptr<cm::Executor> m_executor;
+    struct Producers {
+        std::shared_ptr<msc::AudioSender> audio {};
+        std::shared_ptr<msc::DataSender> data {};
+    };
+
+    cm::Strand m_strand;
+    // Runs produce(), which blocks its thread until the server answers.
+    std::shared_ptr<cm::Executor> m_produce_executor;
     hv::EventLoopPtr m_event_loop;
     net::ProtooClient m_protoo;
     std::shared_ptr<net::HttpClient> m_http_client;
     std::shared_ptr<msc::PeerConnectionFactoryTuple> m_peer_connection_factory;
+    std::shared_ptr<JoinTimings> m_join_timings;
 
     std::shared_ptr<msc::Device> m_device { nullptr };
+    // Held while produce() uses the device off the strand, leave() stops the device under it.
+    std::mutex m_produce_mutex {};
     nlohmann::json m_create_transport_option {};
 
     std::string m_user_id {};
@@ -55,42 +125,87 @@ private:
     std::shared_ptr<msc::DataSender> m_self_data_sender {};
     std::shared_ptr<msc::AudioSender> m_self_audio_sender {};
     std::unordered_map<std::string, Peer> m_peers {};
+    // By consumer id, to close a sink when the server closes its consumer.
+    std::unordered_map<std::string, msc::SinkHandle> m_sinks {};
     bool m_validate_data_channel { true };
+    cm::TimerId m_tick_producer_timer {};
+
+    // Bumped by every joinRoom() and leave(), a join that sees another generation after resuming gives up.
+    std::atomic_uint64_t m_join_generation { 0 };
+    std::future<void> m_join {};
 
 public:
-    ConferencePeer(std::shared_ptr<cm::Executor>, hv::EventLoopPtr, std::shared_ptr<net::HttpClient>, std::shared_ptr<msc::PeerConnectionFactoryTuple>);
+    ConferencePeer(std::shared_ptr<cm::Executor>, std::shared_ptr<cm::Executor> produce_executor, hv::EventLoopPtr, std::shared_ptr<net::HttpClient>, std::shared_ptr<msc::PeerConnectionFactoryTuple>, std::shared_ptr<JoinTimings>);
     ~ConferencePeer() override;
 
-    void joinRoom(std::string user_id, std::string room_id);
+    /**
+     * @param on_finished Called once the join finished, whether it succeeded, failed or was cancelled.
+     */
+    void joinRoom(std::string user_id, std::string room_id, std::function<void()> on_finished = {});
     void leave(bool blocking = false);
 
     void validate_data_channel(bool validate) { m_validate_data_channel = validate; }
-    void tick_producer();
 
     float avg_frame_rate();
 
     ConferenceState state();
 
 private:
+    cm::Task<void> join(uint64_t generation);
+
+    /**
+     * Create this peer's producers on the produce executor. libmediasoupclient waits for the server's answers inside Produce,
+     * which would hold a strand worker for each round trip. Does nothing once the join was cancelled.
+     */
+    cm::Async<Producers> produce(uint64_t generation);
+    void tick_producer();
+
     void on_protoo_notify(net::ProtooNotify);
+    void close_sink(const std::string& consumer_id);
     void on_protoo_request(net::ProtooRequest);
-    void start_consuming(nlohmann::json consumerInfos);
 
-    inline nlohmann::json request(std::string method, nlohmann::json body)
+    template<typename Json>
+    void start_consuming(const Json& consumer_infos);
+
+    /**
+     * Send a request without waiting for it. The future gets read(response data) once the response arrives, or the failure.
+     * read runs on the network thread.
+     */
+    template<typename T, typename Read>
+    std::future<T> request_async(std::string method, nlohmann::json body, Read read)
+    {
+        msc::Completion<T> completion;
+        auto future = completion.future();
+
+        m_protoo.requestAsync(std::move(method), std::move(body), [completion, read = std::move(read)](std::exception_ptr error, net::ProtooResponse resp) {
+            completion.complete(std::move(error), [&]() { return read(response_data(std::move(resp))); });
+        });
+
+        return future;
+    }
+
+    /**
+     * Send a request now and await its data later, for requests that do not depend on each other.
+     */
+    inline cm::Started<net::ProtooResponse> start_request(std::string method, nlohmann::json body)
+    {
+        return cm::start(m_protoo.co_request(std::move(method), std::move(body)));
+    }
+
+    static nlohmann::json response_data(net::ProtooResponse resp)
     {
-        auto resp = m_protoo.request(method, std::move(body)).get();
         if (resp.ok) {
-            return resp.data;
+            return std::move(resp.data);
         }
 
         throw std::runtime_error(resp.error_reason);
     }
 
     msc::CreateTransportOptions create_server_side_transport(msc::TransportKind kind, const nlohmann::json& rtp_capabilities) override;
-    void connect_transport(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters) override;
+    std::future<void> connect_transport_async(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters) override;
 
-    std::string connect_producer(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters) override;
-    std::string connect_data_producer(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol) override;
+    std::future<std::string> connect_producer_async(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters) override;
+    std::future<std::string> connect_data_producer_async(const std::string& transport_id, const nlohmann::json& sctp_parameters, const std::string& label, const std::string& protocol) override;
 
     void on_connection_state_change(msc::TransportKind, const std::string&, const std::string& connection_state) noexcept override;
 };
@@ -1,40 +1,41 @@
 #include "./conference_manager.hpp"
 
-#include "./timer_event_loop.hpp"
 #include <random>
 
 static uint32_t s_starting_user_id = 1;
 
+// Producing holds one of these threads for a signaling round trip, enough of them that joins in flight rarely queue behind each other.
+static constexpr size_t PRODUCE_THREAD_COUNT = 32;
+
 ConferenceManager::ConferenceManager(size_t num_worker_thread, size_t num_network_thread, size_t num_peer_connection_factory)
-    : m_http_client(std::make_shared<net::HttpClient>(std::make_shared<hv::AsyncHttpClient>()))
+    : m_http_client(std::make_shared<net::HttpClient>(m_http_pool))
+    , m_executor(std::make_shared<cm::Executor>(num_worker_thread, cm::Executor::Mode::WorkStealing))
+    , m_produce_executor(std::make_shared<cm::Executor>(PRODUCE_THREAD_COUNT))
 {
     std::random_device rd;
     std::srand(rd());
     m_device_id = "ltb_" + std::to_string(rd());
+    // No retries nor hedges, the auth route is per user and not worth duplicating.
+    m_http_client->set_policy(net::RequestPolicy {
+        .deadline = std::chrono::seconds(5),
+    });
 
     m_event_loops.reserve(num_network_thread);
     for (size_t i = 0; i < num_network_thread; i++) {
         m_event_loops.push_back(std::make_shared<hv::EventLoop>());
     }
 
-    m_executors.reserve(num_worker_thread);
-    for (size_t i = 0; i < num_worker_thread; i++) {
-        m_executors.push_back(std::make_shared<cm::Executor>(1));
-    }
-
     m_peer_connection_factories.reserve(num_peer_connection_factory);
     for (size_t i = 0; i < num_peer_connection_factory; i++) {
         m_peer_connection_factories.push_back(msc::create_peer_connection_factory());
     }
-
-    m_tick_producer_timer = timer_event_loop().setInterval(50, [this](auto) {
-        this->tick_producer();
-    });
 }
 
 ConferenceManager::~ConferenceManager()
 {
-    timer_event_loop().killTimer(m_tick_producer_timer);
+    if (m_ramp)
+        m_ramp->stop();
+
     m_peers.clear();
 }
 
@@ -47,6 +48,10 @@ void ConferenceManager::apply_config(size_t room_count, size_t user_per_room, si
     m_room_count = room_count;
     m_user_per_room = user_per_room;
 
+    // Before taking the lock, a join the ramp is starting takes it too.
+    if (m_ramp)
+        m_ramp->stop();
+
     std::lock_guard lk(m_mutex);
     for (auto& conference : m_peers) {
         conference->leave();
@@ -58,32 +63,34 @@ void ConferenceManager::apply_config(size_t room_count, size_t user_per_room, si
         for (auto i = m_peers.size(); i < required_user_count; i++) {
             m_peers.push_back(
                 std::make_unique<ConferencePeer>(
-                    m_executors[i % m_executors.size()],
+                    m_executor,
+                    m_produce_executor,
                     m_event_loops[i % m_event_loops.size()],
                     m_http_client,
-                    m_peer_connection_factories[i % m_peer_connection_factories.size()]));
+                    m_peer_connection_factories[i % m_peer_connection_factories.size()],
+                    m_join_timings));
         }
     } else if (m_peers.size() > required_user_count) {
         m_peers.resize(required_user_count);
     }
 
+    std::vector<std::pair<std::string, std::string>> identities {};
+    identities.reserve(required_user_count);
     for (size_t i = 0; i < m_room_count; i++) {
         for (size_t j = 0; j < m_user_per_room; j++) {
-            auto& conference = m_peers[i * m_user_per_room + j];
-
             uint32_t user_id = s_starting_user_id++;
-            conference->validate_data_channel(m_validate_data_channel);
-            conference->joinRoom(m_device_id + "_u" + std::to_string(10000 + user_id), m_device_id + "_r" + std::to_string(starting_room_id + i));
+            identities.emplace_back(m_device_id + "_u" + std::to_string(10000 + user_id), m_device_id + "_r" + std::to_string(starting_room_id + i));
         }
     }
-}
 
-void ConferenceManager::tick_producer()
-{
-    std::lock_guard lk(m_mutex);
-    for (auto& conference : m_peers) {
-        conference->tick_producer();
-    }
+    // Peers join in room order, following the ramp profile instead of all at once.
+    m_ramp = std::make_shared<RampScheduler>(m_executor, m_ramp_profile);
+    m_ramp->start(identities.size(), [this, identities = std::move(identities)](size_t index, RampScheduler::Done done) {
+        std::lock_guard lk(m_mutex);
+        auto& conference = m_peers[index];
+        conference->validate_data_channel(m_validate_data_channel);
+        conference->joinRoom(identities[index].first, identities[index].second, std::move(done));
+    });
 }
 
 const ConferenceManager::Stats& ConferenceManager::stats()
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "./conference.hpp"
+#include "./ramp.hpp"
 
+#include <map>
 #include <mutex>
 
 class ConferenceManager {
@@ -16,26 +18,42 @@ public:
 
 private:
     std::string m_device_id;
+    std::shared_ptr<net::HttpPool> m_http_pool { std::make_shared<net::HttpPool>() };
     std::shared_ptr<net::HttpClient> m_http_client;
     std::vector<hv::EventLoopPtr> m_event_loops {};
-    std::vector<std::shared_ptr<cm::Executor>> m_executors {};
+    // Declared before m_peers, the strands of the peers borrow it and their joins wait for the produce executor.
+    std::shared_ptr<cm::Executor> m_executor;
+    std::shared_ptr<cm::Executor> m_produce_executor;
     std::vector<std::shared_ptr<msc::PeerConnectionFactoryTuple>> m_peer_connection_factories {};
+    std::shared_ptr<JoinTimings> m_join_timings { std::make_shared<JoinTimings>() };
 
     std::mutex m_mutex {};
     std::vector<std::unique_ptr<ConferencePeer>> m_peers {};
     size_t m_room_count { 1 };
     size_t m_user_per_room { 4 };
 
-    hv::TimerID m_tick_producer_timer {};
     int64_t m_time_last_report { 0 };
     Stats m_stats {};
     bool m_validate_data_channel { false };
 
+    RampProfile m_ramp_profile {};
+    std::shared_ptr<RampScheduler> m_ramp {};
+
 public:
     ConferenceManager(size_t num_worker_thread, size_t num_network_thread, size_t num_peer_connection_factory);
     ~ConferenceManager();
 
     void validate_data_channel(bool validate) { m_validate_data_channel = validate; }
+
+    /**
+     * Profile of the ramps started by apply_config(), from the next call on.
+     */
+    void set_ramp_profile(RampProfile profile) { m_ramp_profile = profile; }
+    const RampProfile& ramp_profile() const { return m_ramp_profile; }
+
+    /**
+     * Leave and rejoin with the new layout. Peers join following the ramp profile, a ramp still running is stopped first.
+     */
     void apply_config(size_t room_count, size_t user_per_room, size_t starting_room_id = 0);
 
     size_t total_user_count() const
@@ -45,6 +63,29 @@ public:
 
     const Stats& stats();
 
-private:
-    void tick_producer();
+    cm::Executor::Metrics executor_metrics() const
+    {
+        return m_executor->metrics();
+    }
+
+    const JoinTimings& join_timings() const
+    {
+        return *m_join_timings;
+    }
+
+    RampScheduler::Stats ramp_stats() const
+    {
+        return m_ramp ? m_ramp->stats() : RampScheduler::Stats {};
+    }
+
+    net::HttpPool::Stats http_pool_stats() const
+    {
+        return m_http_pool->stats();
+    }
+
+    std::map<std::string, cm::Histogram::Snapshot> http_latencies() const
+    {
+        auto latencies = m_http_pool->endpoint_latencies();
+        return std::map<std::string, cm::Histogram::Snapshot>(latencies.begin(), latencies.end());
+    }
 };
\ No newline at end of file
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <common/crc32.hpp>
-#include <fmt/format.h>
+#include <common/logger.hpp>
 #include <msc/msc.hpp>
 
 struct VideoStat {
@@ -101,7 +101,7 @@ private:
     void on_data(std::span<const uint8_t> data)
     {
         if (data.size() < 4) {
-            fmt::println("[DataConsumer] recv invalid data (too short)");
+            cm::log_rate_limited<cm::LogLevel::Warn>({}, "[DataConsumer] recv invalid data (too short)");
             return;
         }
 
@@ -112,7 +112,7 @@ private:
             cm::CRC32 crc32;
             crc32.update(data.subspan(4));
             if (crc32.digest() != checksum) {
-                fmt::println("[DataConsumer] recv invalid data (checksum failed)");
+                cm::log_rate_limited<cm::LogLevel::Warn>({}, "[DataConsumer] recv invalid data (checksum failed)");
                 return;
             }
         }
@@ -5,7 +5,6 @@
 #include <msc/msc.hpp>
 
 #include "./conference_manager.hpp"
-#include "./timer_event_loop.hpp"
 #include "./ui.hpp"
 #include "./viewer_manager.hpp"
 
@@ -19,6 +18,9 @@ struct CommonConfig {
 void run_livestream_view_bot(const argparse::ArgumentParser& program, CommonConfig config);
 void run_conference_bot(const argparse::ArgumentParser& program, CommonConfig config);
 
+void add_ramp_arguments(argparse::ArgumentParser& program);
+RampProfile parse_ramp_profile(const argparse::ArgumentParser& program);
+
 int main(int argc, const char** argv)
 {
     argparse::ArgumentParser program("load_test_bot");
@@ -27,6 +29,10 @@ int main(int argc, const char** argv)
         .help("disable interactive GUI")
         .default_value(false)
         .implicit_value(true);
+    program.add_argument("--binary-log")
+        .help("write the GUI log file in binary form, render it with log_decoder")
+        .default_value(false)
+        .implicit_value(true);
 
     program.add_argument("-w", "--worker-thread")
         .help("Number of worker thread for blocking mediasoup call")
@@ -52,6 +58,7 @@ int main(int argc, const char** argv)
         .scan<'u', size_t>()
         .metavar("UINT")
         .default_value(size_t(10));
+    add_ramp_arguments(livestream_view_bot);
 
     argparse::ArgumentParser conference_bot("conference");
     conference_bot.add_argument("-r", "--room-count")
@@ -73,6 +80,7 @@ int main(int argc, const char** argv)
         .help("Disable data channel validation")
         .default_value(true)
         .implicit_value(false);
+    add_ramp_arguments(conference_bot);
 
     program.add_subparser(livestream_view_bot);
     program.add_subparser(conference_bot);
@@ -86,7 +94,13 @@ int main(int argc, const char** argv)
     }
 
     bool use_gui = program["--nogui"] == false;
-    cm::init_logger(use_gui ? "load_test.log" : nullptr);
+    if (!use_gui) {
+        cm::init_logger(nullptr);
+    } else if (program["--binary-log"] == true) {
+        cm::init_logger("load_test.cmlog", cm::LogMode::Binary);
+    } else {
+        cm::init_logger("load_test.log");
+    }
 
     cm::log("Initializing...");
     msc::initialize();
@@ -118,6 +132,75 @@ int main(int argc, const char** argv)
     return 0;
 }
 
+void add_ramp_arguments(argparse::ArgumentParser& program)
+{
+    program.add_argument("--ramp")
+        .help("How joins arrive: constant, linear, step or poisson")
+        .metavar("KIND")
+        .default_value(std::string("constant"));
+    program.add_argument("--rate")
+        .help("Joins per second, the peak rate for linear and step")
+        .scan<'g', double>()
+        .metavar("FLOAT")
+        .default_value(50.0);
+    program.add_argument("--start-rate")
+        .help("Joins per second at the start of a linear or step ramp")
+        .scan<'g', double>()
+        .metavar("FLOAT")
+        .default_value(1.0);
+    program.add_argument("--ramp-duration")
+        .help("Seconds for a linear ramp to reach --rate")
+        .scan<'g', double>()
+        .metavar("FLOAT")
+        .default_value(30.0);
+    program.add_argument("--step-rate")
+        .help("Joins per second added by every step")
+        .scan<'g', double>()
+        .metavar("FLOAT")
+        .default_value(10.0);
+    program.add_argument("--step-interval")
+        .help("Seconds between steps")
+        .scan<'g', double>()
+        .metavar("FLOAT")
+        .default_value(5.0);
+    program.add_argument("--max-inflight")
+        .help("Joins in flight at once, 0 for no limit")
+        .scan<'u', size_t>()
+        .metavar("UINT")
+        .default_value(size_t(100));
+    program.add_argument("--seed")
+        .help("Seed of the poisson arrivals, the same seed gives the same run")
+        .scan<'u', size_t>()
+        .metavar("UINT")
+        .default_value(size_t(1));
+}
+
+RampProfile parse_ramp_profile(const argparse::ArgumentParser& program)
+{
+    auto seconds = [](double value) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(value));
+    };
+
+    auto kind_name = program.get<std::string>("--ramp");
+    auto kind = RampProfile::parse_kind(kind_name);
+    if (!kind)
+        throw std::runtime_error("unknown ramp " + kind_name);
+
+    RampProfile profile {
+        .kind = *kind,
+        .rate = program.get<double>("--rate"),
+        .start_rate = program.get<double>("--start-rate"),
+        .ramp_duration = seconds(program.get<double>("--ramp-duration")),
+        .step_rate = program.get<double>("--step-rate"),
+        .step_interval = seconds(program.get<double>("--step-interval")),
+        .max_in_flight = program.get<size_t>("--max-inflight"),
+        .seed = program.get<size_t>("--seed"),
+    };
+
+    profile.validate();
+    return profile;
+}
+
 void run_livestream_view_bot(const argparse::ArgumentParser& program, CommonConfig config)
 {
     std::string streamer_id = program.get<std::string>("--streamer-id");
@@ -125,6 +208,7 @@ void run_livestream_view_bot(const argparse::ArgumentParser& program, CommonConf
 
     std::shared_ptr<ViewerManager> manager = std::make_shared<ViewerManager>(config.num_worker_thread, config.num_network_thread, config.num_peer_connection_factory);
     manager->set_streamer_id(streamer_id);
+    manager->set_ramp_profile(parse_ramp_profile(program));
 
     if (config.use_gui) {
         setup_livestream_bot_ui(manager, viewer_count);
@@ -132,10 +216,15 @@ void run_livestream_view_bot(const argparse::ArgumentParser& program, CommonConf
     }
 
     std::thread refresh_ui([&] {
+        auto previous_metrics = manager->executor_metrics();
         while (true) {
             using namespace std::chrono_literals;
             std::this_thread::sleep_for(500ms);
 
+            auto executor_metrics = manager->executor_metrics();
+            auto interval_metrics = executor_metrics.since(previous_metrics);
+            previous_metrics = std::move(executor_metrics);
+
             auto video_stats = manager->video_stats();
             auto state_stats = manager->state_stats();
 
@@ -144,7 +233,7 @@ void run_livestream_view_bot(const argparse::ArgumentParser& program, CommonConf
             size_t failed = state_stats[ViewerState::Failed] + state_stats[ViewerState::Disconnected] + state_stats[ViewerState::Closed];
             size_t error = state_stats[ViewerState::GettingAuthTokenFailed] + state_stats[ViewerState::StreamNotFound] + state_stats[ViewerState::ConsumeStreamFailed] + state_stats[ViewerState::Exception];
 
-            auto out = fmt::format("\r[init={:2} ok={:2} fail={:2} err={:2} | avgFps={:8.4f}]", init, success, failed, error, video_stats.avgFps);
+            auto out = fmt::format("\r[init={:2} ok={:2} fail={:2} err={:2} | avgFps={:8.4f} | {} | {} | {} | {}]", init, success, failed, error, video_stats.avgFps, format_ramp_stats(manager->ramp_stats()), format_executor_metrics(interval_metrics), format_http_pool_stats(manager->http_pool_stats()), format_http_cache_stats(manager->http_cache_stats()));
             std::cout << out;
             std::cout.flush();
 
@@ -166,6 +255,7 @@ void run_conference_bot(const argparse::ArgumentParser& program, CommonConfig co
 
     std::shared_ptr<ConferenceManager> manager = std::make_shared<ConferenceManager>(config.num_worker_thread, config.num_network_thread, config.num_peer_connection_factory);
     manager->validate_data_channel(validate_data_channel);
+    manager->set_ramp_profile(parse_ramp_profile(program));
 
     if (config.use_gui) {
         setup_conference_bot_ui(manager, room_count, user_count, room_id);
@@ -173,7 +263,18 @@ void run_conference_bot(const argparse::ArgumentParser& program, CommonConfig co
     }
 
     manager->apply_config(room_count, user_count, room_id);
-    timer_event_loop_thread().join();
 
-    cm::log("Exit somewhat gracefully\n");
+    auto previous_metrics = manager->executor_metrics();
+    while (true) {
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(1s);
+
+        auto executor_metrics = manager->executor_metrics();
+        cm::log("[Executor] {}", format_executor_metrics(executor_metrics.since(previous_metrics)));
+        cm::log("[Ramp] {}", format_ramp_stats(manager->ramp_stats()));
+        cm::log("[Join] {}", format_join_timings(manager->join_timings()));
+        cm::log("[Http] {}", format_http_pool_stats(manager->http_pool_stats()));
+        cm::log("[Http] {}", format_http_latencies(manager->http_latencies()));
+        previous_metrics = std::move(executor_metrics);
+    }
 }
@@ -0,0 +1,331 @@
+#include "./ramp.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using Seconds = std::chrono::duration<double>;
+
+std::chrono::microseconds to_offset(double seconds)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Seconds(seconds));
+}
+
+}
+
+std::optional<RampProfile::Kind> RampProfile::parse_kind(const std::string& name)
+{
+    for (auto kind : { Kind::Constant, Kind::Linear, Kind::Step, Kind::Poisson }) {
+        if (name == RampProfile::name(kind))
+            return kind;
+    }
+
+    return std::nullopt;
+}
+
+const char* RampProfile::name(Kind kind)
+{
+    switch (kind) {
+    case Kind::Constant:
+        return "constant";
+    case Kind::Linear:
+        return "linear";
+    case Kind::Step:
+        return "step";
+    case Kind::Poisson:
+        return "poisson";
+    }
+
+    return "unknown";
+}
+
+void RampProfile::validate() const
+{
+    if (!(rate > 0))
+        throw std::invalid_argument("ramp rate must be positive");
+
+    if (start_rate < 0 || step_rate < 0)
+        throw std::invalid_argument("ramp start and step rates must not be negative");
+
+    if (kind == Kind::Linear && ramp_duration <= std::chrono::milliseconds::zero())
+        throw std::invalid_argument("ramp duration must be positive");
+
+    if (kind == Kind::Step) {
+        if (step_interval <= std::chrono::milliseconds::zero())
+            throw std::invalid_argument("ramp step interval must be positive");
+
+        if (start_rate == 0 && step_rate == 0)
+            throw std::invalid_argument("ramp start or step rate must be positive");
+    }
+}
+
+double RampProfile::rate_at(std::chrono::duration<double> elapsed) const
+{
+    switch (kind) {
+    case Kind::Constant:
+    case Kind::Poisson:
+        return rate;
+    case Kind::Linear: {
+        double duration = Seconds(ramp_duration).count();
+        if (elapsed.count() >= duration)
+            return rate;
+
+        return start_rate + (rate - start_rate) * elapsed.count() / duration;
+    }
+    case Kind::Step: {
+        double steps = std::floor(elapsed.count() / Seconds(step_interval).count());
+        return std::min(rate, start_rate + steps * step_rate);
+    }
+    }
+
+    return rate;
+}
+
+std::vector<std::chrono::microseconds> RampProfile::arrival_times(size_t count) const
+{
+    std::vector<std::chrono::microseconds> times {};
+    times.reserve(count);
+
+    switch (kind) {
+    case Kind::Constant:
+        for (size_t i = 0; i < count; i++) {
+            times.push_back(to_offset(double(i) / rate));
+        }
+        break;
+    case Kind::Linear: {
+        // Arrival i is due when the integral of the rate reaches i: start_rate * t + slope * t^2 / 2 during the ramp.
+        double duration = Seconds(ramp_duration).count();
+        double slope = (rate - start_rate) / duration;
+        double ramp_arrivals = (start_rate + rate) / 2 * duration;
+
+        for (size_t i = 0; i < count; i++) {
+            auto n = double(i);
+            if (n == 0) {
+                times.push_back(to_offset(0));
+            } else if (n < ramp_arrivals) {
+                // The root of the quadratic written so that it does not cancel out when slope is close to zero.
+                times.push_back(to_offset(2 * n / (start_rate + std::sqrt(start_rate * start_rate + 2 * slope * n))));
+            } else {
+                times.push_back(to_offset(duration + (n - ramp_arrivals) / rate));
+            }
+        }
+        break;
+    }
+    case Kind::Step: {
+        double interval = Seconds(step_interval).count();
+        size_t step = 0;
+        double step_start = 0;
+        double arrivals_before_step = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            auto n = double(i);
+            while (true) {
+                double step_rate_now = std::min(rate, start_rate + double(step) * step_rate);
+                if (step_rate_now == rate || n < arrivals_before_step + step_rate_now * interval) {
+                    times.push_back(to_offset(step_start + (n - arrivals_before_step) / step_rate_now));
+                    break;
+                }
+
+                arrivals_before_step += step_rate_now * interval;
+                step_start += interval;
+                step++;
+            }
+        }
+        break;
+    }
+    case Kind::Poisson: {
+        std::mt19937_64 rng(seed);
+        std::exponential_distribution<double> gap(rate);
+
+        double t = 0;
+        for (size_t i = 0; i < count; i++) {
+            times.push_back(to_offset(t));
+            t += gap(rng);
+        }
+        break;
+    }
+    }
+
+    return times;
+}
+
+double RampScheduler::Stats::target_rate() const
+{
+    if (schedule_elapsed.count() <= 0 || scheduled == 0)
+        return 0;
+
+    // The first arrival is due at zero, the rate is over the gaps after it.
+    return double(scheduled - 1) / schedule_elapsed.count();
+}
+
+double RampScheduler::Stats::achieved_rate() const
+{
+    if (elapsed.count() <= 0 || started == 0)
+        return 0;
+
+    return double(started - 1) / elapsed.count();
+}
+
+RampScheduler::RampScheduler(std::shared_ptr<cm::Executor> executor, RampProfile profile)
+    : m_executor(std::move(executor))
+    , m_profile(profile)
+{
+    m_profile.validate();
+}
+
+RampScheduler::~RampScheduler()
+{
+    stop();
+}
+
+void RampScheduler::start(size_t count, Arrival arrival)
+{
+    {
+        std::lock_guard pump_lock(m_pump_mutex);
+        m_arrival = std::move(arrival);
+
+        std::lock_guard lk(m_mutex);
+        m_times = m_profile.arrival_times(count);
+        m_started_at = std::chrono::steady_clock::now();
+    }
+
+    m_executor->push_task([weak = weak_from_this()]() {
+        if (auto self = weak.lock())
+            self->pump();
+    });
+}
+
+void RampScheduler::stop()
+{
+    std::lock_guard pump_lock(m_pump_mutex);
+    // Drops whatever the arrival holds on to, e.g. the viewers of a ramp that was cut short.
+    m_arrival = nullptr;
+
+    std::lock_guard lk(m_mutex);
+    if (m_stopped)
+        return;
+
+    m_stopped = true;
+    m_stopped_at = std::chrono::steady_clock::now() - m_started_at;
+    if (m_timer) {
+        m_executor->cancel_timer(*m_timer);
+        m_timer.reset();
+    }
+}
+
+RampScheduler::Stats RampScheduler::stats()
+{
+    std::lock_guard lk(m_mutex);
+
+    Stats stats = m_stats;
+    stats.count = m_times.size();
+    if (stats.count == 0)
+        return stats;
+
+    auto now = std::chrono::steady_clock::now() - m_started_at;
+    if (m_stopped)
+        now = m_stopped_at;
+
+    if (m_next == m_times.size()) {
+        // Every arrival started, compare the whole schedule with how long it actually took.
+        stats.elapsed = m_last_arrival;
+        stats.schedule_elapsed = m_times.back();
+        stats.scheduled = m_times.size();
+    } else {
+        stats.elapsed = now;
+        stats.schedule_elapsed = now;
+        stats.scheduled = size_t(std::upper_bound(m_times.begin(), m_times.end(), now) - m_times.begin());
+    }
+
+    stats.current_rate = m_profile.rate_at(stats.elapsed);
+    return stats;
+}
+
+void RampScheduler::pump()
+{
+    std::lock_guard pump_lock(m_pump_mutex);
+
+    while (true) {
+        size_t index = 0;
+        {
+            std::lock_guard lk(m_mutex);
+            if (m_stopped || m_next == m_times.size())
+                return;
+
+            auto now = std::chrono::steady_clock::now() - m_started_at;
+            if (m_times[m_next] > now) {
+                if (!m_timer) {
+                    auto delay = std::chrono::ceil<std::chrono::milliseconds>(m_times[m_next] - now);
+                    m_timer = m_executor->schedule_after(delay, [weak = weak_from_this()]() {
+                        if (auto self = weak.lock()) {
+                            {
+                                std::lock_guard lk(self->m_mutex);
+                                self->m_timer.reset();
+                            }
+
+                            self->pump();
+                        }
+                    });
+                }
+
+                return;
+            }
+
+            if (m_profile.max_in_flight != 0 && m_stats.in_flight >= m_profile.max_in_flight) {
+                // on_done() pumps again once a join finishes. Every arrival due by now starts late.
+                auto due = size_t(std::upper_bound(m_times.begin() + ptrdiff_t(m_next), m_times.end(), now) - m_times.begin());
+                if (due > m_held) {
+                    m_stats.throttled += due - std::max(m_held, m_next);
+                    m_held = due;
+                }
+
+                return;
+            }
+
+            index = m_next++;
+            m_last_arrival = now;
+            m_stats.started++;
+            m_stats.in_flight++;
+            m_stats.peak_in_flight = std::max(m_stats.peak_in_flight, m_stats.in_flight);
+        }
+
+        m_arrival(index, [weak = weak_from_this()]() {
+            if (auto self = weak.lock())
+                self->on_done();
+        });
+    }
+}
+
+void RampScheduler::on_done()
+{
+    {
+        std::lock_guard lk(m_mutex);
+        m_stats.in_flight--;
+        m_stats.finished++;
+    }
+
+    // Not inline: done() may be called by a join unwinding while its owner holds the lock the next arrival takes.
+    if (m_profile.max_in_flight != 0) {
+        m_executor->push_task([weak = weak_from_this()]() {
+            if (auto self = weak.lock())
+                self->pump();
+        });
+    }
+}
+
+cm::Task<void> notify_when_done(cm::Task<void> task, RampScheduler::Done done)
+{
+    std::exception_ptr error {};
+    try {
+        co_await std::move(task);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    done();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <common/executor.hpp>
+#include <common/task.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * When the joins of a load test start.
+ * The same profile and seed always give the same arrival times, so capacity runs can be repeated.
+ */
+struct RampProfile {
+    enum class Kind {
+        // rate arrivals per second, evenly spaced.
+        Constant,
+        // From start_rate up to rate over ramp_duration, then rate.
+        Linear,
+        // start_rate, plus step_rate every step_interval, up to rate.
+        Step,
+        // rate arrivals per second on average, with exponentially distributed gaps drawn from seed.
+        Poisson,
+    };
+
+    Kind kind { Kind::Constant };
+    // Arrivals per second, the peak rate for Linear and Step.
+    double rate { 50 };
+    double start_rate { 1 };
+    std::chrono::milliseconds ramp_duration { std::chrono::seconds(30) };
+    double step_rate { 10 };
+    std::chrono::milliseconds step_interval { std::chrono::seconds(5) };
+    // Joins in flight at once, an arrival waits for one to finish once this is reached. 0 for no limit.
+    size_t max_in_flight { 100 };
+    uint64_t seed { 1 };
+
+    /**
+     * @return The kind named name, as given on the command line, std::nullopt if there is none.
+     */
+    static std::optional<Kind> parse_kind(const std::string& name);
+    static const char* name(Kind kind);
+
+    /**
+     * @throw std::invalid_argument If the profile would never start every arrival, e.g. its rate is not positive.
+     */
+    void validate() const;
+
+    /**
+     * Arrivals per second the profile asks for at elapsed, the mean rate for Poisson.
+     */
+    double rate_at(std::chrono::duration<double> elapsed) const;
+
+    /**
+     * Offsets of the first count arrivals from the start of the ramp, in order.
+     */
+    std::vector<std::chrono::microseconds> arrival_times(size_t count) const;
+};
+
+/**
+ * Starts joins following a RampProfile, on timers of the executor, instead of all at once.
+ *
+ * Create it with std::make_shared.
+ */
+class RampScheduler : public std::enable_shared_from_this<RampScheduler> {
+public:
+    // To be called once when the join finished, whether it succeeded or not.
+    using Done = std::function<void()>;
+    // Start join index, it runs on the executor and must not block.
+    using Arrival = std::function<void(size_t index, Done done)>;
+
+    struct Stats {
+        size_t count { 0 };
+        // Arrivals due by now according to the profile.
+        size_t scheduled { 0 };
+        size_t started { 0 };
+        size_t finished { 0 };
+        size_t in_flight { 0 };
+        size_t peak_in_flight { 0 };
+        // Arrivals that were due while max_in_flight joins were in flight, and started late.
+        size_t throttled { 0 };
+        // Since start, until the last arrival started.
+        std::chrono::duration<double> elapsed {};
+        // Since start, until the last arrival was due.
+        std::chrono::duration<double> schedule_elapsed {};
+        // What the profile asks for at elapsed.
+        double current_rate { 0 };
+
+        /**
+         * Mean arrivals per second the profile asked for over schedule_elapsed, and the mean actually started over elapsed.
+         */
+        double target_rate() const;
+        double achieved_rate() const;
+    };
+
+    /**
+     * @throw std::invalid_argument If the profile is not valid.
+     */
+    RampScheduler(std::shared_ptr<cm::Executor> executor, RampProfile profile);
+    ~RampScheduler();
+
+    RampScheduler(const RampScheduler&) = delete;
+    RampScheduler& operator=(const RampScheduler&) = delete;
+
+    /**
+     * Start count joins, calling arrival for each index in order, on the executor. Only call it once.
+     */
+    void start(size_t count, Arrival arrival);
+
+    /**
+     * Start no more joins. An arrival already running is waited for, the joins in flight are left alone.
+     */
+    void stop();
+
+    const RampProfile& profile() const { return m_profile; }
+    Stats stats();
+
+private:
+    /**
+     * Start every arrival that is due, as long as the in-flight limit allows, and set a timer for the next one.
+     */
+    void pump();
+    void on_done();
+
+private:
+    std::shared_ptr<cm::Executor> m_executor;
+    RampProfile m_profile;
+
+    // Held while arrivals are started, so that stop() returns only once none is.
+    std::mutex m_pump_mutex {};
+    Arrival m_arrival {};
+
+    std::mutex m_mutex {};
+    std::vector<std::chrono::microseconds> m_times {};
+    std::chrono::steady_clock::time_point m_started_at {};
+    std::chrono::steady_clock::duration m_last_arrival {};
+    std::chrono::steady_clock::duration m_stopped_at {};
+    size_t m_next { 0 };
+    // Arrivals before this one were held back by the in-flight limit.
+    size_t m_held { 0 };
+    std::optional<cm::TimerId> m_timer {};
+    bool m_stopped { false };
+    Stats m_stats {};
+};
+
+/**
+ * Await task, then call done, also when the task threw.
+ */
+cm::Task<void> notify_when_done(cm::Task<void> task, RampScheduler::Done done);
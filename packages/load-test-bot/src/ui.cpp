@@ -10,6 +10,190 @@
 #include <ftxui/component/screen_interactive.hpp>
 #include <ftxui/dom/elements.hpp>
 
+namespace {
+
+/**
+ * Keeps the executor metrics of the last full interval, the renderer runs on every UI event and would otherwise show noise.
+ */
+class ExecutorMetricsWindow {
+public:
+    const cm::Executor::Metrics& update(const cm::Executor::Metrics& current)
+    {
+        using namespace std::chrono_literals;
+
+        if (current.uptime - m_previous.uptime >= 1s) {
+            m_interval = current.since(m_previous);
+            m_previous = current;
+        }
+
+        m_interval.queue_depth = current.queue_depth;
+        return m_interval;
+    }
+
+private:
+    cm::Executor::Metrics m_previous {};
+    cm::Executor::Metrics m_interval {};
+};
+
+ftxui::Element executor_metrics_panel(const cm::Executor::Metrics& metrics)
+{
+    std::vector<ftxui::Element> children {
+        ftxui::text("=== Executor ===") | ftxui::bold,
+        ftxui::text(fmt::format("Queue depth : {}", metrics.queue_depth)),
+        ftxui::text(fmt::format("Tasks/s     : {:.0f}", metrics.tasks_per_second())),
+        ftxui::text(fmt::format("Wait p50/p99: {}us / {}us", metrics.wait_time.percentile(0.5), metrics.wait_time.percentile(0.99))),
+        ftxui::text(fmt::format("Run  p50/p99: {}us / {}us", metrics.run_time.percentile(0.5), metrics.run_time.percentile(0.99))),
+    };
+
+    for (size_t i = 0; i < metrics.workers.size(); i++) {
+        float busy = float(metrics.busy_ratio(i));
+        children.push_back(ftxui::hbox({ ftxui::text(fmt::format("worker {:02} ", i)),
+            ftxui::gauge(busy),
+            ftxui::text(fmt::format(" {:3.0f}%", busy * 100)) }));
+    }
+
+    return ftxui::vbox(std::move(children));
+}
+
+ftxui::Element join_timings_panel(const JoinTimings& timings)
+{
+    std::vector<ftxui::Element> children {
+        ftxui::text("=== Join p50/p99 ===") | ftxui::bold,
+    };
+
+    for (size_t i = 0; i < kJoinStageCount; i++) {
+        auto snapshot = timings.stages[i].snapshot();
+        children.push_back(ftxui::text(fmt::format("{:10}: {}ms / {}ms", JoinTimings::name(JoinStage(i)), snapshot.percentile(0.5), snapshot.percentile(0.99))));
+    }
+
+    return ftxui::vbox(std::move(children));
+}
+
+ftxui::Element ramp_panel(const RampProfile& profile, const RampScheduler::Stats& stats)
+{
+    return ftxui::vbox({
+        ftxui::text(fmt::format("=== Ramp ({}) ===", RampProfile::name(profile.kind))) | ftxui::bold,
+        ftxui::hbox({ ftxui::text("Started     "),
+            ftxui::gauge(stats.count == 0 ? 0.0f : float(stats.started) / float(stats.count)),
+            ftxui::text(fmt::format(" {}/{}", stats.started, stats.count)) }),
+        ftxui::text(fmt::format("Rate now    : {:.1f}/s", stats.current_rate)),
+        ftxui::text(fmt::format("Target rate : {:.1f}/s", stats.target_rate())),
+        ftxui::text(fmt::format("Achieved    : {:.1f}/s", stats.achieved_rate())),
+        ftxui::text(fmt::format("In flight   : {} (peak {}, max {})", stats.in_flight, stats.peak_in_flight, profile.max_in_flight)),
+        ftxui::text(fmt::format("Throttled   : {}", stats.throttled)),
+    });
+}
+
+ftxui::Element http_pool_panel(const net::HttpPool::Stats& stats, const net::HttpCache::Stats& cache_stats, const std::map<std::string, cm::Histogram::Snapshot>& latencies)
+{
+    const auto& dns = net::DnsCache::instance();
+    std::vector<ftxui::Element> children {
+        ftxui::text("=== HTTP pool ===") | ftxui::bold,
+        ftxui::text(fmt::format("Hosts       : {} ({} closed idle)", stats.hosts, stats.hosts_closed)),
+        ftxui::text(fmt::format("Connections : {}", stats.connections)),
+        ftxui::text(fmt::format("In flight   : {} ({} waiting)", stats.in_flight, stats.waiting)),
+        ftxui::text(fmt::format("Requests    : {} ({} waited)", stats.requests, stats.waited)),
+        ftxui::text(fmt::format("DNS hit/miss: {} / {}", dns.hits(), dns.misses())),
+        ftxui::text(fmt::format("Cache hits  : {:3.0f}% ({} hit, {} coalesced, {} miss)", cache_stats.hit_rate() * 100, cache_stats.hits, cache_stats.coalesced, cache_stats.misses)),
+        ftxui::text(fmt::format("Retries     : {} ({} past deadline)", stats.retries, stats.deadline_exceeded)),
+        ftxui::text(fmt::format("Hedges      : {} ({} won)", stats.hedges, stats.hedge_wins)),
+        ftxui::text("=== HTTP p50/p95/p99 ===") | ftxui::bold,
+    };
+
+    for (const auto& [endpoint, snapshot] : latencies) {
+        children.push_back(ftxui::text(fmt::format("{}: {}ms / {}ms / {}ms", endpoint, snapshot.percentile(0.5), snapshot.percentile(0.95), snapshot.percentile(0.99))));
+    }
+
+    return ftxui::vbox(std::move(children));
+}
+
+}
+
+std::string format_http_pool_stats(const net::HttpPool::Stats& stats)
+{
+    const auto& dns = net::DnsCache::instance();
+    return fmt::format("hosts={} conns={} in_flight={} waiting={} requests={} waited={} retries={} hedges={}/{} timeouts={} dns={}/{}",
+        stats.hosts,
+        stats.connections,
+        stats.in_flight,
+        stats.waiting,
+        stats.requests,
+        stats.waited,
+        stats.retries,
+        stats.hedge_wins,
+        stats.hedges,
+        stats.deadline_exceeded,
+        dns.hits(),
+        dns.misses());
+}
+
+std::string format_http_latencies(const std::map<std::string, cm::Histogram::Snapshot>& latencies)
+{
+    std::string out;
+    for (const auto& [endpoint, snapshot] : latencies) {
+        if (!out.empty())
+            out += ' ';
+
+        out += fmt::format("{}={}/{}/{}ms", endpoint, snapshot.percentile(0.5), snapshot.percentile(0.95), snapshot.percentile(0.99));
+    }
+
+    return out;
+}
+
+std::string format_http_cache_stats(const net::HttpCache::Stats& stats)
+{
+    return fmt::format("cache_hit={:3.0f}% hit={} coalesced={} miss={} entries={}",
+        stats.hit_rate() * 100,
+        stats.hits,
+        stats.coalesced,
+        stats.misses,
+        stats.entries);
+}
+
+std::string format_ramp_stats(const RampScheduler::Stats& stats)
+{
+    return fmt::format("started={}/{} target={:.1f}/s achieved={:.1f}/s now={:.1f}/s in_flight={} throttled={}",
+        stats.started,
+        stats.count,
+        stats.target_rate(),
+        stats.achieved_rate(),
+        stats.current_rate,
+        stats.in_flight,
+        stats.throttled);
+}
+
+std::string format_join_timings(const JoinTimings& timings)
+{
+    std::string out;
+    for (size_t i = 0; i < kJoinStageCount; i++) {
+        auto snapshot = timings.stages[i].snapshot();
+        if (!out.empty())
+            out += ' ';
+
+        out += fmt::format("{}={}/{}ms", JoinTimings::name(JoinStage(i)), snapshot.percentile(0.5), snapshot.percentile(0.99));
+    }
+
+    return out;
+}
+
+std::string format_executor_metrics(const cm::Executor::Metrics& metrics)
+{
+    double busy = 0;
+    for (size_t i = 0; i < metrics.workers.size(); i++) {
+        busy += metrics.busy_ratio(i);
+    }
+
+    if (!metrics.workers.empty())
+        busy /= double(metrics.workers.size());
+
+    return fmt::format("queue={} tasks/s={:.0f} wait_p99={}us run_p99={}us busy={:3.0f}%",
+        metrics.queue_depth,
+        metrics.tasks_per_second(),
+        metrics.wait_time.percentile(0.99),
+        metrics.run_time.percentile(0.99),
+        busy * 100);
+}
+
 void setup_livestream_bot_ui(std::shared_ptr<ViewerManager> manager, size_t default_viewer_count)
 {
     std::string streamer_id = manager->streamer_id();
@@ -52,6 +236,7 @@ void setup_livestream_bot_ui(std::shared_ptr<ViewerManager> manager, size_t defa
         return ftxui::vbox(children);
     };
 
+    ExecutorMetricsWindow executor_metrics_window;
     auto renderer = ftxui::Renderer(
         ftxui::Container::Vertical({
             input_streamer_id,
@@ -61,6 +246,8 @@ void setup_livestream_bot_ui(std::shared_ptr<ViewerManager> manager, size_t defa
         [&]() {
             auto state_stats = manager->state_stats();
             auto video_stats = manager->video_stats();
+            const auto& executor_metrics = executor_metrics_window.update(manager->executor_metrics());
+            auto http_pool_stats = manager->http_pool_stats();
 
             return ftxui::vbox({
                        ftxui::vbox({
@@ -102,6 +289,14 @@ void setup_livestream_bot_ui(std::shared_ptr<ViewerManager> manager, size_t defa
                                ftxui::text("Screen Resolutions") | ftxui::bold,
                                resolution_table(video_stats.resolution),
                            }) | ftxui::flex,
+                           ftxui::separator(),
+                           ftxui::vbox({
+                               ramp_panel(manager->ramp_profile(), manager->ramp_stats()),
+                               ftxui::separator(),
+                               executor_metrics_panel(executor_metrics),
+                               ftxui::separator(),
+                               http_pool_panel(http_pool_stats, manager->http_cache_stats(), manager->http_latencies()),
+                           }) | ftxui::flex,
                        }),
                    })
                 | ftxui::border;
@@ -179,6 +374,7 @@ void setup_conference_bot_ui(std::shared_ptr<ConferenceManager> manager, size_t
         return ftxui::vbox(children);
     };
 
+    ExecutorMetricsWindow executor_metrics_window;
     auto renderer
         = ftxui::Renderer(
             ftxui::Container::Vertical({
@@ -189,6 +385,7 @@ void setup_conference_bot_ui(std::shared_ptr<ConferenceManager> manager, size_t
             }),
             [&]() {
                 auto stats = manager->stats();
+                const auto& executor_metrics = executor_metrics_window.update(manager->executor_metrics());
 
                 return ftxui::vbox({
                            ftxui::vbox({
@@ -230,6 +427,14 @@ void setup_conference_bot_ui(std::shared_ptr<ConferenceManager> manager, size_t
                                    gauge("productive peer ", stats.productive_peer),
                                    consumer_count_gauge(stats.consume_peer),
                                }) | ftxui::flex,
+                               ftxui::separator(),
+                               ftxui::vbox({
+                                   ramp_panel(manager->ramp_profile(), manager->ramp_stats()),
+                                   ftxui::separator(),
+                                   join_timings_panel(manager->join_timings()),
+                               }) | ftxui::flex,
+                               ftxui::separator(),
+                               executor_metrics_panel(executor_metrics) | ftxui::flex,
                            }),
                        })
                     | ftxui::border;
@@ -3,6 +3,39 @@
 #include "conference_manager.hpp"
 #include "viewer_manager.hpp"
 
+#include <map>
+#include <string>
+
+/**
+ * One line summary of executor metrics, for headless mode.
+ */
+std::string format_executor_metrics(const cm::Executor::Metrics& metrics);
+
+/**
+ * One line summary of the join ramp, achieved against target arrival rate, for headless mode.
+ */
+std::string format_ramp_stats(const RampScheduler::Stats& stats);
+
+/**
+ * One line summary of join stage timings, p50/p99 since start, for headless mode.
+ */
+std::string format_join_timings(const JoinTimings& timings);
+
+/**
+ * One line summary of HTTP connection pool stats and the shared DNS cache, for headless mode.
+ */
+std::string format_http_pool_stats(const net::HttpPool::Stats& stats);
+
+/**
+ * One line summary of the shared HTTP response cache, for headless mode.
+ */
+std::string format_http_cache_stats(const net::HttpCache::Stats& stats);
+
+/**
+ * Per endpoint p50/p95/p99 latency, for headless mode.
+ */
+std::string format_http_latencies(const std::map<std::string, cm::Histogram::Snapshot>& latencies);
+
 void setup_livestream_bot_ui(std::shared_ptr<ViewerManager> manager, size_t default_viewer_count);
 
 void setup_conference_bot_ui(std::shared_ptr<ConferenceManager> manager, size_t room_count, size_t user_count, size_t base_room_id);
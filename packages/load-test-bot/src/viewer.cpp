@@ -1,17 +1,28 @@
 #include "viewer.hpp"
 
+#include <common/json_arena.hpp>
 #include <common/logger.hpp>
 
-#include "timer_event_loop.hpp"
-
 static constexpr bool USE_LIVE_SERVER = false;
 static const std::string ENDPOINT = USE_LIVE_SERVER ? "https://portal-voicevideo.service.zingplay.com" : "https://portal-mediasoup-dev.service.zingplay.com";
 
-Viewer::Viewer(std::shared_ptr<hv::AsyncHttpClient> http_client, std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory)
-    : m_client(std::move(http_client))
+// /stats/sign is a read only GET, safe to retry and hedge. Every other request, the /live/ping with its side effects included, is sent once.
+static const net::RequestPolicy SIGN_POLICY {
+    .deadline = std::chrono::seconds(5),
+    .max_retries = 2,
+    .hedge = true,
+};
+
+Viewer::Viewer(std::shared_ptr<cm::Executor> executor, std::shared_ptr<net::HttpPool> http_pool, std::shared_ptr<net::HttpCache> http_cache, std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory)
+    : m_executor(std::move(executor))
+    , m_client(std::move(http_pool))
     , m_peer_connection_factory(std::move(peer_connection_factory))
     , m_screen_consumer(std::make_shared<ReportVideoConsumer>())
 {
+    m_client.set_cache(std::move(http_cache));
+    m_client.set_policy(net::RequestPolicy {
+        .deadline = std::chrono::seconds(5),
+    });
 }
 
 Viewer::~Viewer()
@@ -19,8 +30,10 @@ Viewer::~Viewer()
     stop();
 }
 
-void Viewer::watch(std::string streamer_id)
+cm::Task<void> Viewer::watch(std::string streamer_id)
 {
+    auto self = shared_from_this();
+
     m_streamer_id = std::move(streamer_id);
     if (!m_device)
         m_device = msc::Device::create(this, m_peer_connection_factory);
@@ -32,24 +45,36 @@ void Viewer::watch(std::string streamer_id)
 
     try {
         if (m_session_key.empty()) {
-            auto tokenResp = m_client.get(ENDPOINT + "/stats/sign").get();
+            auto tokenResp = co_await m_client.co_get_cached(ENDPOINT + "/stats/sign", SIGN_POLICY);
+            if (!tokenResp) {
+                cm::log_error("Error cannot get token: request failed");
+                m_state = ViewerState::GettingAuthTokenFailed;
+                co_return;
+            }
+
             auto tokenJson = tokenResp->GetJson();
             if (!tokenJson.value("ok", false)) {
-                cm::log("Error cannot get token: {}", tokenJson.dump(2));
+                cm::log_error("Error cannot get token: {}", tokenJson.dump(2));
                 m_state = ViewerState::GettingAuthTokenFailed;
-                return;
+                co_return;
             }
 
             m_client.headers()["Authorization"] = "Bearer " + tokenJson.at("token").get<std::string>();
         }
 
-        auto resp = m_client.post(ENDPOINT + "/live/" + m_streamer_id + "/watch", nlohmann::json::object()).get();
+        auto resp = co_await m_client.co_post(ENDPOINT + "/live/" + m_streamer_id + "/watch", nlohmann::json::object());
+        if (!resp) {
+            cm::log_error("Watch error: request failed");
+            m_state = ViewerState::Exception;
+            co_return;
+        }
+
         auto watch_response = resp->GetJson();
 
         if (!watch_response.value("ok", true)) {
-            cm::log("Watch error: {}", watch_response.dump(2));
+            cm::log_error("Watch error: {}", watch_response.dump(2));
             m_state = ViewerState::StreamNotFound;
-            return;
+            co_return;
         }
 
         m_state = ViewerState::CreatingTransport;
@@ -58,13 +83,22 @@ void Viewer::watch(std::string streamer_id)
         m_device->ensure_transport(msc::TransportKind::Recv);
 
         m_state = ViewerState::Consuming;
-        resp = m_client.post(ENDPOINT + "/live/" + m_streamer_id + "/consume", { { "rtpCapabilities", m_device->rtp_capabilities() } }).get();
+        nlohmann::json consume_body = { { "rtpCapabilities", m_device->rtp_capabilities() } };
+        resp = co_await m_client.co_post(ENDPOINT + "/live/" + m_streamer_id + "/consume", consume_body);
+        if (!resp) {
+            cm::log_error("Consume error: request failed");
+            m_state = ViewerState::ConsumeStreamFailed;
+            co_return;
+        }
 
-        auto consume_response = resp->GetJson();
+        // Only the rtpParameters outlive this response, the rest of its DOM goes away with the arena.
+        cm::JsonArena arena;
+        cm::JsonArenaScope arena_scope(arena);
+        auto consume_response = cm::ArenaJson::parse(resp->body);
         if (!consume_response.value("ok", true)) {
-            cm::log("Consume error got: {}", consume_response.dump(2));
+            cm::log_error("Consume error got: {}", consume_response.dump(2));
             m_state = ViewerState::ConsumeStreamFailed;
-            return;
+            co_return;
         }
 
         for (auto& consumer : consume_response.at("data")) {
@@ -99,11 +133,11 @@ void Viewer::watch(std::string streamer_id)
         }
 
         m_client.post(ENDPOINT + "/live/" + m_streamer_id + "/resume", nlohmann::json::object());
-        m_ping_interval = timer_event_loop().setInterval(3000, [this](auto) {
+        m_ping_interval = m_executor->schedule_every(std::chrono::seconds(3), [this]() {
             m_client.getAsync(ENDPOINT + "/live/ping", nullptr);
         });
     } catch (const std::exception& ex) {
-        cm::log("Exception: {}", ex.what());
+        cm::log_error("Exception: {}", ex.what());
         m_state = ViewerState::Exception;
     }
 }
@@ -115,7 +149,7 @@ void Viewer::stop()
 
     m_stopped = true;
 
-    timer_event_loop().killTimer(m_ping_interval);
+    m_executor->cancel_timer(m_ping_interval);
     m_device->stop();
 }
 
@@ -134,14 +168,20 @@ msc::CreateTransportOptions Viewer::create_server_side_transport(msc::TransportK
     return options;
 }
 
-void Viewer::connect_transport(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters)
+std::future<void> Viewer::connect_transport_async(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters)
 {
     (void)transport_id;
     nlohmann::json body = {
         { "dtlsParameters", dtls_parameters }
     };
 
-    m_client.post(ENDPOINT + "/live/" + m_streamer_id + "/connectTransport", body).get();
+    msc::Completion<void> completion;
+    auto future = completion.future();
+    m_client.postAsync(ENDPOINT + "/live/" + m_streamer_id + "/connectTransport", body, [completion](const std::shared_ptr<HttpResponse>& resp) {
+        completion.complete(resp ? nullptr : std::make_exception_ptr(std::runtime_error("connectTransport failed")), []() {});
+    });
+
+    return future;
 }
 
 void Viewer::on_connection_state_change(msc::TransportKind, const std::string&, const std::string& connection_state) noexcept
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <common/executor.hpp>
+#include <common/task.hpp>
 #include <msc/msc.hpp>
 #include <net/http_client.hpp>
 
@@ -26,7 +28,7 @@ enum class ViewerState {
 class Viewer : public msc::DeviceDelegate
     , public std::enable_shared_from_this<Viewer> {
 public:
-    explicit Viewer(std::shared_ptr<hv::AsyncHttpClient> http_client, std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory);
+    explicit Viewer(std::shared_ptr<cm::Executor> executor, std::shared_ptr<net::HttpPool> http_pool, std::shared_ptr<net::HttpCache> http_cache, std::shared_ptr<msc::PeerConnectionFactoryTuple> peer_connection_factory);
     ~Viewer() override;
 
     VideoStat video_stat()
@@ -39,16 +41,20 @@ public:
         return m_state;
     }
 
-    void watch(std::string streamer_id);
+    /**
+     * Runs on the viewer's executor, the viewer is kept alive until the task finishes.
+     */
+    cm::Task<void> watch(std::string streamer_id);
 
 private:
     void stop();
 
     msc::CreateTransportOptions create_server_side_transport(msc::TransportKind kind, const nlohmann::json& rtp_capabilities) override;
-    void connect_transport(msc::TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters) override;
+    std::future<void> connect_transport_async(msc::TransportKind kind, const std::string& transport_id, const nlohmann::json& dtls_parameters) override;
     void on_connection_state_change(msc::TransportKind, const std::string&, const std::string& connection_state) noexcept override;
 
 private:
+    std::shared_ptr<cm::Executor> m_executor;
     net::HttpClient m_client;
     std::shared_ptr<msc::PeerConnectionFactoryTuple> m_peer_connection_factory;
     std::shared_ptr<ReportVideoConsumer> m_screen_consumer;
@@ -60,6 +66,6 @@ private:
     nlohmann::json m_create_transport_option {};
 
     std::string m_session_key {};
-    hv::TimerID m_ping_interval {};
+    cm::TimerId m_ping_interval {};
     bool m_stopped { true };
 };
\ No newline at end of file
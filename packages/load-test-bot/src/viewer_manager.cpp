@@ -3,11 +3,11 @@
 #include <fmt/core.h>
 
 ViewerManager::ViewerManager(size_t num_worker_thread, size_t num_network_thread, size_t num_peer_connection_factory)
-    : m_executor(std::make_unique<cm::Executor>(num_worker_thread))
+    : m_executor(std::make_shared<cm::Executor>(num_worker_thread, cm::Executor::Mode::WorkStealing))
 {
-    m_http_clients.reserve(num_network_thread);
+    m_http_pools.reserve(num_network_thread);
     for (size_t i = 0; i < num_network_thread; i++) {
-        m_http_clients.push_back(std::make_shared<hv::AsyncHttpClient>());
+        m_http_pools.push_back(std::make_shared<net::HttpPool>());
     }
 
     m_peer_connection_factories.reserve(num_peer_connection_factory);
@@ -21,22 +21,56 @@ void ViewerManager::set_viewer_count(size_t viewer_count)
     if (m_viewers.size() == viewer_count)
         return;
 
+    // Viewers the running ramp did not get to yet are handed to the next one.
+    size_t first_waiting = m_viewers.size();
+    if (m_ramp) {
+        m_ramp->stop();
+        first_waiting = m_ramp_first + m_ramp->stats().started;
+    }
+
     if (viewer_count < m_viewers.size()) {
         m_viewers.resize(viewer_count);
     } else {
         auto new_viewer_count = viewer_count - m_viewers.size();
 
         for (size_t i = 0; i < new_viewer_count; i++) {
-            std::shared_ptr<hv::AsyncHttpClient> http_client = m_http_clients[m_viewers.size() % m_http_clients.size()];
+            std::shared_ptr<net::HttpPool> http_pool = m_http_pools[m_viewers.size() % m_http_pools.size()];
             std::shared_ptr<msc::PeerConnectionFactoryTuple> pc = m_peer_connection_factories[m_viewers.size() % m_peer_connection_factories.size()];
-            auto viewer = std::make_shared<Viewer>(http_client, pc);
+            m_viewers.push_back(std::make_shared<Viewer>(m_executor, http_pool, m_http_cache, pc));
+        }
+    }
+
+    if (first_waiting >= m_viewers.size())
+        return;
+
+    std::vector<std::shared_ptr<Viewer>> joining(m_viewers.begin() + ptrdiff_t(first_waiting), m_viewers.end());
+    m_ramp = std::make_shared<RampScheduler>(m_executor, m_ramp_profile);
+    m_ramp_first = first_waiting;
+    m_ramp->start(joining.size(), [executor = m_executor, joining = std::move(joining), streamer_id = m_streamer_id](size_t index, RampScheduler::Done done) {
+        cm::spawn(*executor, notify_when_done(joining[index]->watch(streamer_id), std::move(done)));
+    });
+}
 
-            m_viewers.push_back(viewer);
-            m_executor->push_task([this, viewer]() {
-                viewer->watch(m_streamer_id);
-            });
+net::HttpPool::Stats ViewerManager::http_pool_stats() const
+{
+    net::HttpPool::Stats stats {};
+    for (const auto& pool : m_http_pools) {
+        stats += pool->stats();
+    }
+
+    return stats;
+}
+
+std::map<std::string, cm::Histogram::Snapshot> ViewerManager::http_latencies() const
+{
+    std::map<std::string, cm::Histogram::Snapshot> latencies {};
+    for (const auto& pool : m_http_pools) {
+        for (const auto& [endpoint, snapshot] : pool->endpoint_latencies()) {
+            latencies[endpoint].merge(snapshot);
         }
     }
+
+    return latencies;
 }
 
 std::unordered_map<ViewerState, int> ViewerManager::state_stats()
@@ -2,6 +2,9 @@
 
 #include <net/http_client.hpp>
 
+#include <map>
+
+#include "ramp.hpp"
 #include "viewer.hpp"
 
 struct VideoStats {
@@ -23,6 +26,18 @@ public:
         return m_streamer_id;
     }
 
+    /**
+     * Profile of the ramps started by set_viewer_count(), from the next call on.
+     */
+    void set_ramp_profile(RampProfile profile)
+    {
+        m_ramp_profile = profile;
+    }
+
+    /**
+     * Add or remove viewers. New viewers start watching following the ramp profile,
+     * together with the viewers a previous call left waiting for their turn.
+     */
     void set_viewer_count(size_t viewer_count);
 
     size_t viewer_count() const
@@ -33,11 +48,44 @@ public:
     std::unordered_map<ViewerState, int> state_stats();
     VideoStats video_stats();
 
+    cm::Executor::Metrics executor_metrics() const
+    {
+        return m_executor->metrics();
+    }
+
+    const RampProfile& ramp_profile() const
+    {
+        return m_ramp_profile;
+    }
+
+    RampScheduler::Stats ramp_stats() const
+    {
+        return m_ramp ? m_ramp->stats() : RampScheduler::Stats {};
+    }
+
+    net::HttpPool::Stats http_pool_stats() const;
+
+    net::HttpCache::Stats http_cache_stats() const
+    {
+        return m_http_cache->stats();
+    }
+
+    /**
+     * Per endpoint latency in milliseconds, merged over every pool.
+     */
+    std::map<std::string, cm::Histogram::Snapshot> http_latencies() const;
+
 private:
-    std::unique_ptr<cm::Executor> m_executor;
-    std::vector<std::shared_ptr<hv::AsyncHttpClient>> m_http_clients {};
+    std::shared_ptr<cm::Executor> m_executor;
+    std::vector<std::shared_ptr<net::HttpPool>> m_http_pools {};
+    std::shared_ptr<net::HttpCache> m_http_cache { std::make_shared<net::HttpCache>() };
     std::vector<std::shared_ptr<msc::PeerConnectionFactoryTuple>> m_peer_connection_factories {};
 
     std::string m_streamer_id {};
     std::vector<std::shared_ptr<Viewer>> m_viewers {};
+
+    RampProfile m_ramp_profile {};
+    std::shared_ptr<RampScheduler> m_ramp {};
+    // Index in m_viewers of the viewer the current ramp starts first.
+    size_t m_ramp_first { 0 };
 };
\ No newline at end of file
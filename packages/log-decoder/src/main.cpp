@@ -0,0 +1,73 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <argparse/argparse.hpp>
+
+#include <common/binary_log.hpp>
+
+namespace {
+
+cm::LogLevel parse_level(const std::string& level)
+{
+    if (level == "trace")
+        return cm::LogLevel::Trace;
+    if (level == "debug")
+        return cm::LogLevel::Debug;
+    if (level == "info")
+        return cm::LogLevel::Info;
+    if (level == "warn")
+        return cm::LogLevel::Warn;
+    if (level == "error")
+        return cm::LogLevel::Error;
+
+    throw std::runtime_error("Unknown level: " + level);
+}
+
+}
+
+int main(int argc, const char** argv)
+{
+    argparse::ArgumentParser program("log_decoder");
+
+    program.add_argument("input")
+        .help("Binary log written with cm::LogMode::Binary");
+    program.add_argument("-o", "--output")
+        .help("Write the text log to this file instead of stdout");
+    program.add_argument("-l", "--level")
+        .help("Lowest level to print: trace, debug, info, warn or error")
+        .default_value(std::string("trace"));
+
+    cm::LogLevel min_level;
+    try {
+        program.parse_args(argc, argv);
+        min_level = parse_level(program.get<std::string>("--level"));
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    auto input_path = program.get<std::string>("input");
+    std::ifstream input(input_path, std::ios::in | std::ios::binary);
+    if (!input) {
+        std::cerr << "Cannot open " << input_path << std::endl;
+        return 1;
+    }
+
+    std::ofstream output_file;
+    if (auto output_path = program.present("--output")) {
+        output_file.open(*output_path);
+        if (!output_file) {
+            std::cerr << "Cannot open " << *output_path << std::endl;
+            return 1;
+        }
+    }
+
+    if (!cm::decode_binary_log(input, output_file.is_open() ? output_file : std::cout, min_level)) {
+        std::cerr << input_path << " is not a binary log" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
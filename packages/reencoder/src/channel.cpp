@@ -15,12 +15,26 @@ void Channel::start()
 
 nlohmann::json Channel::request(std::string method, nlohmann::json body)
 {
-    int64_t id = m_id_gen++;
-    std::promise<nlohmann::json> promise;
-    auto future = promise.get_future();
+    auto promise = std::make_shared<std::promise<nlohmann::json>>();
+    auto future = promise->get_future();
+    request_async(std::move(method), std::move(body), [promise](std::exception_ptr error, nlohmann::json data) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(data));
+        }
+    });
+
+    return future.get();
+}
+
+void Channel::request_async(std::string method, nlohmann::json body, ResponseCallback callback)
+{
+    int64_t id = 0;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_promises.emplace(id, std::move(promise));
+        id = m_id_gen++;
+        m_pending.emplace(id, std::move(callback));
     }
 
     std::cout << nlohmann::json({
@@ -31,8 +45,6 @@ nlohmann::json Channel::request(std::string method, nlohmann::json body)
                                 })
                      .dump()
               << std::endl;
-
-    return future.get();
 }
 
 void Channel::notify(std::string method, nlohmann::json data)
@@ -84,19 +96,26 @@ void Channel::worker_thread()
                 });
             } else {
                 auto id = message.at("id").get<int64_t>();
-                auto it = m_promises.find(id);
-                if (it != m_promises.end()) {
+                ResponseCallback callback {};
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    auto it = m_pending.find(id);
+                    if (it != m_pending.end()) {
+                        callback = std::move(it->second);
+                        m_pending.erase(it);
+                    }
+                }
+
+                if (callback) {
                     if (type == TypeResponseSuccess) {
-                        it->second.set_value(message.at("data"));
+                        callback(nullptr, std::move(message.at("data")));
                     } else {
-                        it->second.set_exception(std::make_exception_ptr(std::runtime_error(message.at("data").dump(2))));
+                        callback(std::make_exception_ptr(std::runtime_error(message.at("data").dump(2))), nullptr);
                     }
-
-                    m_promises.erase(it);
                 }
             }
         } catch (const std::exception& ex) {
-            cm::log("SocketWorkerError: {}", ex.what());
+            cm::log_error("SocketWorkerError: {}", ex.what());
         }
     }
 }
\ No newline at end of file
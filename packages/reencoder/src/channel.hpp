@@ -28,10 +28,13 @@ public:
         nlohmann::json data;
     };
 
+    // Gets the response data, or the error if the request failed. Runs on the channel's thread.
+    using ResponseCallback = std::function<void(std::exception_ptr, nlohmann::json)>;
+
 private:
     std::thread m_thread {};
     std::mutex m_mutex {};
-    std::unordered_map<int64_t, std::promise<nlohmann::json>> m_promises {};
+    std::unordered_map<int64_t, ResponseCallback> m_pending {};
     int64_t m_id_gen { 1 };
     bool m_running { true };
 
@@ -45,6 +48,7 @@ public:
     void start();
 
     nlohmann::json request(std::string, nlohmann::json);
+    void request_async(std::string, nlohmann::json, ResponseCallback);
     void notify(std::string, nlohmann::json);
     void response(Request, Result, nlohmann::json);
 
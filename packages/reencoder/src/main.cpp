@@ -90,7 +90,7 @@ public:
                     auto reencoder = m_device->re_encode(stream.is_audio ? msc::MediaKind::Audio : msc::MediaKind::Video, stream.consumer_options, stream.producer_options);
                     m_reencoder_streams.push_back(reencoder);
                 } catch (const std::exception& e) {
-                    cm::log("ReEncodeError: {}", e.what());
+                    cm::log_error("ReEncodeError: {}", e.what());
                 }
             }
         });
@@ -120,22 +120,35 @@ private:
         return options;
     }
 
-    void connect_transport(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters) noexcept override
+    std::future<void> connect_transport_async(msc::TransportKind, const std::string& transport_id, const nlohmann::json& dtls_parameters) noexcept override
     {
-        m_channel->request("connectTransport", {
-                                                   { "transportId", transport_id },
-                                                   { "dtlsParameters", dtls_parameters },
-                                               });
+        msc::Completion<void> completion;
+        auto future = completion.future();
+        m_channel->request_async("connectTransport", {
+                                                         { "transportId", transport_id },
+                                                         { "dtlsParameters", dtls_parameters },
+                                                     },
+            [completion](std::exception_ptr error, nlohmann::json) {
+                completion.complete(std::move(error), []() {});
+            });
+
+        return future;
     }
 
-    std::string connect_producer(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters) noexcept override
+    std::future<std::string> connect_producer_async(const std::string& transport_id, msc::MediaKind kind, const nlohmann::json& rtp_parameters) noexcept override
     {
-        auto info = m_channel->request("connectProducer", {
-                                                              { "kind", kind == msc::MediaKind::Audio ? "audio" : "video" },
-                                                              { "rtpParameters", rtp_parameters },
-                                                          });
-
-        return info.at("producerId").get<std::string>();
+        (void)transport_id;
+        msc::Completion<std::string> completion;
+        auto future = completion.future();
+        m_channel->request_async("connectProducer", {
+                                                        { "kind", kind == msc::MediaKind::Audio ? "audio" : "video" },
+                                                        { "rtpParameters", rtp_parameters },
+                                                    },
+            [completion](std::exception_ptr error, nlohmann::json info) {
+                completion.complete(std::move(error), [&]() { return info.at("producerId").get<std::string>(); });
+            });
+
+        return future;
     }
 };
 